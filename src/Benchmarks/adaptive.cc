@@ -0,0 +1,64 @@
+// Uniform vs adaptive sampling on scene1 and scene10.
+// Build and run from src/ (like main.cc):
+//   g++ -std=c++17 -O2 -pthread Benchmarks/adaptive.cc -o adaptive
+//   ./adaptive [width] [spp] [threads] [tolerance]
+// The adaptive renders may use up to 4x spp per pixel. Noise is the seed-to-seed variance as in
+// integrator.cc, "time to equal noise" scales each render time to the variance of the uniform one.
+// adaptive_scene<N>_samples.ppm shows where the samples went.
+
+#include "bench.h"
+#include "ppm.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv) {
+    int width        = argc > 1 ? atoi(argv[1]) : 200;
+    int spp          = argc > 2 ? atoi(argv[2]) : 64;
+    int threads      = argc > 3 ? atoi(argv[3]) : int(std::thread::hardware_concurrency());
+    double tolerance = argc > 4 ? atof(argv[4]) : 0.1;
+
+    bvh_node::default_options.split  = bvh_options::sah;
+    bvh_node::default_options.layout = bvh_options::wide4;
+
+    std::cout << std::fixed << std::setprecision(3);
+    for(int scene : {1, 10}) {
+        double uniform_variance = 0;
+        for(bool adaptive : {false, true}) {
+            double seconds = 0;
+            std::vector<int> image[2];
+            for(int run = 0; run < 2; run++) {
+                hittable_list world;
+                hittable_list lights;
+                camera cam;
+                setup_scene(scene, world, lights, cam, width, spp, 50);
+                cam.adaptive = adaptive;
+                cam.max_samples_per_pixel = 4 * spp;
+                cam.adaptive_tolerance = tolerance;
+                cam.seed = run;
+                std::string name = std::string("adaptive_scene") + std::to_string(scene);
+                cam.output = name + (adaptive ? "_adaptive_" : "_uniform_") + std::to_string(run) + ".ppm";
+                if(adaptive && run == 0)
+                    cam.samples_output = name + "_samples.ppm";
+
+                seconds += timed_render(cam, world, lights, threads);
+
+                if(!read_ppm(cam.output, image[run])) {
+                    std::cerr << "Cannot read back ../Rendered_Images/" << cam.output << '\n';
+                    return 1;
+                }
+            }
+
+            double variance = mean_squared_error(image[0], image[1]) / 2;
+            if(!adaptive)
+                uniform_variance = variance;
+
+            std::cout << "Scene " << scene << ", " << (adaptive ? "adaptive" : "uniform ") << ": "
+                      << seconds / 2 << " s, variance " << variance
+                      << ", time to equal noise " << seconds / 2 * variance / uniform_variance << " s\n";
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,40 @@
+#ifndef BENCHMARK_BENCH_H
+#define BENCHMARK_BENCH_H
+
+#include "../Helper/rtweekend.h"
+
+#include "../Bounding_Volume_Hierarchies/bvh.h"
+#include "../camera.h"
+#include "../Hittable/hittable_list.h"
+#include "../scenes.h"
+
+#include <chrono>
+
+// Builds scene 'id' (1 to 15, as in scenes.h) for a benchmark run: no per-thread report after
+// rendering. Scenes that place objects with random_double() use the calling thread's sequence,
+// which earlier renders leave elsewhere, so it is reset first and every run builds the same scene.
+// False for an unknown id.
+inline bool setup_scene(int id, hittable_list& world, hittable_list& lights, camera& cam, int width, int spp, int depth) {
+    using scene_function = void (*)(hittable_list&, hittable_list&, camera&, int, int, int);
+    static const scene_function scenes[] = {
+        scene1, scene2, scene3, scene4, scene5, scene6, scene7, scene8,
+        scene9, scene10, scene11, scene12, scene13, scene14, scene15,
+    };
+    if(id < 1 || id > int(sizeof(scenes) / sizeof(scenes[0])))
+        return false;
+
+    thread_rng().seed(0);
+    scenes[id - 1](world, lights, cam, width, spp, depth);
+    cam.thread_stats = false;
+    return true;
+}
+
+// Wall-clock seconds of one render, without denoising
+inline double timed_render(camera& cam, const hittable& world, const hittable& lights, int threads) {
+    auto begin = std::chrono::steady_clock::now();
+    cam.render(world, lights, threads, false);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    return elapsed.count();
+}
+
+#endif
@@ -0,0 +1,72 @@
+// Recursive vs iterative integrator (with and without Russian roulette) on the Cornell box scenes.
+// Build and run from src/ (like main.cc):
+//   g++ -std=c++17 -O2 -pthread Benchmarks/integrator.cc -o integrator
+//   ./integrator [width] [spp] [threads]
+// Noise is estimated from two renders with different seeds: their mean squared difference is
+// twice the per-pixel variance, so no converged reference image is needed. "Time to equal noise"
+// scales each render time to the variance of the recursive integrator (variance ~ 1/spp).
+
+#include "bench.h"
+#include "ppm.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+struct config {
+    const char* name;
+    camera::integratorType integrator;
+    int rr_min_depth;
+};
+
+int main(int argc, char** argv) {
+    int width   = argc > 1 ? atoi(argv[1]) : 200;
+    int spp     = argc > 2 ? atoi(argv[2]) : 64;
+    int threads = argc > 3 ? atoi(argv[3]) : int(std::thread::hardware_concurrency());
+
+    bvh_node::default_options.split  = bvh_options::sah;
+    bvh_node::default_options.layout = bvh_options::wide4;
+
+    const config configs[] = {
+        {"recursive",            camera::recursive, 0},
+        {"iterative",            camera::iterative, 1 << 30},
+        {"iterative + roulette", camera::iterative, camera().rr_min_depth},
+    };
+
+    std::cout << std::fixed << std::setprecision(3);
+    for(int scene : {10, 11}) {
+        double reference_variance = 0;
+        for(const auto& c : configs) {
+            double seconds = 0;
+            double samples = 0;
+            std::vector<int> image[2];
+            for(int run = 0; run < 2; run++) {
+                hittable_list world;
+                hittable_list lights;
+                camera cam;
+                setup_scene(scene, world, lights, cam, width, spp, 50);
+                cam.integrator = c.integrator;
+                cam.rr_min_depth = c.rr_min_depth;
+                cam.seed = run;
+                cam.output = "integrator_scene" + std::to_string(scene) + "_" + std::to_string(run) + ".ppm";
+                seconds += timed_render(cam, world, lights, threads);
+                samples += double(cam.image_width) * int(cam.image_width / cam.aspect_ratio) * spp;
+
+                if(!read_ppm(cam.output, image[run])) {
+                    std::cerr << "Cannot read back ../Rendered_Images/" << cam.output << '\n';
+                    return 1;
+                }
+            }
+
+            double variance = mean_squared_error(image[0], image[1]) / 2;
+            if(reference_variance == 0)
+                reference_variance = variance;
+
+            std::cout << "Scene " << scene << ", " << c.name << ": "
+                      << samples / seconds / 1e6 << " Msamples/s, variance " << variance
+                      << ", time to equal noise " << seconds / 2 * variance / reference_variance << " s\n";
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,33 @@
+// Material throughput: bounces per second on the material-heavy scenes 1 (the five material
+// spheres) and 3 (the random spheres of the In One Weekend cover).
+// Build and run from src/ (like main.cc):
+//   g++ -std=c++17 -O2 -pthread Benchmarks/materials.cc -o materials
+//   ./materials [width] [spp] [threads]
+// Every traced ray (camera ray or bounce) is one hit test plus one material evaluation, so
+// Mrays/s compares the cost of the material dispatch between builds of the tracer.
+
+#include "bench.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <string>
+
+int main(int argc, char** argv) {
+    int width   = argc > 1 ? atoi(argv[1]) : 200;
+    int spp     = argc > 2 ? atoi(argv[2]) : 32;
+    int threads = argc > 3 ? atoi(argv[3]) : 1;
+
+    std::cout << std::fixed << std::setprecision(3);
+    for(int scene : {1, 3}) {
+        hittable_list world;
+        hittable_list lights;
+        camera cam;
+        setup_scene(scene, world, lights, cam, width, spp, 50);
+        cam.output = "materials_scene" + std::to_string(scene) + ".ppm";
+        double seconds = timed_render(cam, world, lights, threads);
+
+        std::cout << "Scene " << scene << ": " << cam.traced_rays() << " rays in " << seconds << " s, "
+                  << cam.traced_rays() / seconds / 1e6 << " Mrays/s\n";
+    }
+    return 0;
+}
@@ -0,0 +1,37 @@
+#ifndef BENCHMARK_PPM_H
+#define BENCHMARK_PPM_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Reads back a P3 or P6 image as written by camera::render
+inline bool read_ppm(const std::string& name, std::vector<int>& pixels) {
+    std::ifstream file("../Rendered_Images/" + name, std::ios::binary);
+    std::string magic;
+    int width, height, max_value;
+    if(!(file >> magic >> width >> height >> max_value) || (magic != "P3" && magic != "P6"))
+        return false;
+    pixels.resize(size_t(width) * height * 3);
+    if(magic == "P6") {
+        file.get(); // Single whitespace after the header
+        std::vector<unsigned char> bytes(pixels.size());
+        if(!file.read(reinterpret_cast<char*>(bytes.data()), std::streamsize(bytes.size())))
+            return false;
+        pixels.assign(bytes.begin(), bytes.end());
+        return true;
+    }
+    for(auto& value : pixels)
+        if(!(file >> value)) return false;
+    return true;
+}
+
+// Mean squared difference of two images of the same size, in 8-bit units
+inline double mean_squared_error(const std::vector<int>& a, const std::vector<int>& b) {
+    double squared = 0;
+    for(size_t i = 0; i < a.size(); i++)
+        squared += double(a[i] - b[i]) * (a[i] - b[i]);
+    return squared / a.size();
+}
+
+#endif
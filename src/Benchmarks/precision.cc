@@ -0,0 +1,70 @@
+// Float vs double geometry kernel: throughput and image error on the reference scenes.
+// Build it twice and run both from src/ (like main.cc), double first, it is the reference:
+//   g++ -std=c++17 -O2 -pthread Benchmarks/precision.cc -o precision_double
+//   g++ -std=c++17 -O2 -pthread -DRT_SINGLE_PRECISION Benchmarks/precision.cc -o precision_float
+//   ./precision_double [width] [spp] [threads]
+//   ./precision_float  [width] [spp] [threads]
+// Every scene is rendered with the default node tree and with wide4 nodes. Each run writes
+// precision_<mode>_<layout>_scene<N>.ppm, the float run compares against the double images.
+
+#include "bench.h"
+#include "ppm.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+const char* mode = sizeof(real) == sizeof(float) ? "float" : "double";
+
+std::string image_name(const char* precision, const char* layout, int scene) {
+    return std::string("precision_") + precision + "_" + layout + "_scene" + std::to_string(scene) + ".ppm";
+}
+
+void compare(const char* layout, int scene) {
+    std::vector<int> reference, image;
+    if(!read_ppm(image_name("double", layout, scene), reference) || !read_ppm(image_name(mode, layout, scene), image)
+        || reference.size() != image.size()) {
+        std::cout << "  no double reference for this size\n";
+        return;
+    }
+    int max_diff = 0;
+    for(size_t i = 0; i < image.size(); i++)
+        max_diff = std::max(max_diff, std::abs(image[i] - reference[i]));
+    double rmse = sqrt(mean_squared_error(image, reference));
+    std::cout << "  vs double: RMSE " << rmse << ", PSNR " << 20 * log10(255 / fmax(rmse, 1e-12))
+              << " dB, max diff " << max_diff << '\n';
+}
+
+int main(int argc, char** argv) {
+    int width   = argc > 1 ? atoi(argv[1]) : 300;
+    int spp     = argc > 2 ? atoi(argv[2]) : 64;
+    int threads = argc > 3 ? atoi(argv[3]) : int(std::thread::hardware_concurrency());
+
+    const struct {
+        const char* name;
+        bvh_options::node_layout layout;
+    } layouts[] = {{"tree", bvh_options::tree}, {"wide4", bvh_options::wide4}};
+
+    bvh_node::default_options.split = bvh_options::sah;
+
+    std::cout << std::fixed << std::setprecision(3);
+    for(const auto& l : layouts) {
+        bvh_node::default_options.layout = l.layout;
+        // Scene 3 has the radius-1000 ground sphere, scene 10 thin quads far from the origin
+        for(int scene : {1, 3, 10, 12}) {
+            hittable_list world;
+            hittable_list lights;
+            camera cam;
+            setup_scene(scene, world, lights, cam, width, spp, scene == 12 ? 4 : 10);
+            cam.output = image_name(mode, l.name, scene);
+            double seconds = timed_render(cam, world, lights, threads);
+
+            std::cout << "Scene " << scene << " (" << mode << ", " << l.name << "): " << seconds << " s, "
+                      << cam.traced_rays() / seconds / 1e6 << " Mrays/s\n";
+            if(sizeof(real) != sizeof(double))
+                compare(l.name, scene);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,52 @@
+// Multi-thread scaling: the same render with 1, 2, 4, ... threads, up to the hardware threads.
+// Build and run from src/ (like main.cc):
+//   g++ -std=c++17 -O2 -pthread Benchmarks/threads.cc -o threads
+//   ./threads [scene] [width] [spp] [max threads]
+// The default scene 12 (The Next Week final scene) sends nearly all rays to the same few
+// materials, so any per-hit write to shared data, like a refcount in the hit record, shows up as
+// lost speedup.
+// Speedup and efficiency are relative to the single-thread run.
+
+#include "bench.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <string>
+
+int main(int argc, char** argv) {
+    int scene       = argc > 1 ? atoi(argv[1]) : 12;
+    int width       = argc > 2 ? atoi(argv[2]) : 200;
+    int spp         = argc > 3 ? atoi(argv[3]) : 32;
+    int max_threads = argc > 4 ? atoi(argv[4]) : int(std::thread::hardware_concurrency());
+    if(max_threads < 1)
+        max_threads = 1;
+
+    std::cout << std::fixed << std::setprecision(3);
+    double single = 0;
+    for(int threads = 1; ; threads *= 2) {
+        if(threads > max_threads)
+            threads = max_threads;
+
+        hittable_list world;
+        hittable_list lights;
+        camera cam;
+        if(!setup_scene(scene, world, lights, cam, width, spp, scene == 12 ? 4 : 50)) {
+            std::cerr << "No scene " << scene << '\n';
+            return 1;
+        }
+        cam.output = "threads_scene" + std::to_string(scene) + ".ppm";
+        double seconds = timed_render(cam, world, lights, threads);
+
+        double samples = double(cam.image_width) * int(cam.image_width / cam.aspect_ratio) * spp;
+        double rate = samples / seconds / 1e6;
+        if(threads == 1)
+            single = rate;
+
+        std::cout << "Scene " << scene << ", " << threads << " threads: " << rate << " Msamples/s, speedup "
+                  << rate / single << ", efficiency " << rate / single / threads << '\n';
+
+        if(threads == max_threads)
+            break;
+    }
+    return 0;
+}
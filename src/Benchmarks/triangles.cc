@@ -0,0 +1,208 @@
+// Ray-triangle kernels on leaf-sized groups of triangles: scalar Möller-Trumbore, the scalar
+// watertight test and the SIMD triangle_pack test, plus a leak test through shared edges.
+// Build and run from src/ (like main.cc):
+//   g++ -std=c++17 -O2 Benchmarks/triangles.cc -o triangles            (SSE: 4 lanes)
+//   g++ -std=c++17 -O2 -mavx Benchmarks/triangles.cc -o triangles_avx  (AVX: 4 doubles or 8 floats)
+//   ./triangles [million tests]
+// Add -DRT_SINGLE_PRECISION for float lanes. The per-ray setup of the watertight tests is done
+// once per ray outside the timed loop, as the mesh does once per traversal.
+
+#include "../Helper/rtweekend.h"
+
+#include "../Hittable/triangle_pack.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <vector>
+
+using pack = triangle_pack<real, triangle_pack_width>;
+
+struct triangle {
+    point3 p[3];
+};
+
+// The test the mesh used before the packs
+bool moller_trumbore(const triangle& tri, const ray& r, const interval& ray_t, real& t, real& b1, real& b2) {
+    vec3 e1 = tri.p[1] - tri.p[0];
+    vec3 e2 = tri.p[2] - tri.p[0];
+    vec3 pvec = cross(r.direction(), e2);
+    real det = dot(e1, pvec);
+    if(det == 0)
+        return false;
+    real inv_det = 1 / det;
+
+    vec3 tvec = r.origin() - tri.p[0];
+    b1 = dot(tvec, pvec) * inv_det;
+    if(b1 < 0 || b1 > 1)
+        return false;
+
+    vec3 qvec = cross(tvec, e1);
+    b2 = dot(r.direction(), qvec) * inv_det;
+    if(b2 < 0 || b1 + b2 > 1)
+        return false;
+
+    t = dot(e2, qvec) * inv_det;
+    return ray_t.surrounds(t);
+}
+
+std::vector<triangle> sphere_triangles(int segments) {
+    // Closed sphere, counter-clockwise from outside, triangles of a ring strip next to each other
+    int rings = segments / 2;
+    auto vertex = [&](int r, int s) {
+        // Same vertices as sphere_mesh(), exact at the poles and the seam
+        double theta = pi * r / rings, phi = 2 * pi * (s % segments) / segments;
+        double sin_theta = (r == 0 || r == rings) ? 0 : sin(theta);
+        return point3(-cos(phi) * sin_theta, -cos(theta), sin(phi) * sin_theta);
+    };
+    std::vector<triangle> tris;
+    for(int r = 0; r < rings; r++) {
+        for(int s = 0; s < segments; s++) {
+            point3 a = vertex(r, s), b = vertex(r, s + 1), c = vertex(r + 1, s), d = vertex(r + 1, s + 1);
+            if(r > 0)
+                tris.push_back({{a, b, c}});
+            if(r < rings - 1)
+                tris.push_back({{b, d, c}});
+        }
+    }
+    return tris;
+}
+
+std::vector<pack> make_packs(const std::vector<triangle>& tris) {
+    std::vector<pack> packs;
+    for(size_t first = 0; first < tris.size(); first += triangle_pack_width) {
+        pack pk;
+        pk.first = uint32_t(first);
+        pk.count = int(std::min(tris.size() - first, size_t(triangle_pack_width)));
+        for(int lane = 0; lane < triangle_pack_width; lane++) {
+            const triangle& tri = tris[first + std::min(lane, pk.count - 1)];
+            pk.set(lane, tri.p[0], tri.p[1], tri.p[2]);
+        }
+        packs.push_back(pk);
+    }
+    return packs;
+}
+
+template <typename F>
+double seconds(F&& f) {
+    auto begin = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    return elapsed.count();
+}
+
+void leak_test(const std::vector<triangle>& tris, const std::vector<pack>& packs) {
+    // Rays from the center of the closed sphere through every vertex and edge midpoint must all hit
+    std::vector<vec3> directions;
+    for(const auto& tri : tris) {
+        for(int k = 0; k < 3; k++) {
+            directions.push_back(tri.p[k]);
+            directions.push_back((tri.p[k] + tri.p[(k + 1) % 3]) / 2);
+        }
+    }
+
+    size_t leaks_mt = 0, leaks_wt = 0;
+    for(const vec3& d : directions) {
+        ray r(point3(0, 0, 0), d);
+        interval ray_t(0, infinity);
+        real t, b1, b2;
+        bool hit = false;
+        for(const auto& tri : tris)
+            hit = hit || moller_trumbore(tri, r, ray_t, t, b1, b2);
+        leaks_mt += !hit;
+
+        watertight_ray<real> wr(r);
+        hit = false;
+        for(const auto& pk : packs)
+            hit = hit || pk.intersect(wr, ray_t, t, b1, b2) >= 0;
+        leaks_wt += !hit;
+    }
+    std::cout << "Leak test, " << directions.size() << " rays through vertices and edges: "
+              << leaks_mt << " missed by Moller-Trumbore, " << leaks_wt << " by the watertight packs\n";
+}
+
+int main(int argc, char** argv) {
+    double millions = argc > 1 ? atof(argv[1]) : 4;
+
+    auto tris = sphere_triangles(256);
+    auto packs = make_packs(tris);
+
+    // Rays from outside the sphere aimed at a random pack, the way a leaf visit looks
+    struct query {
+        ray r;
+        int pack;
+    };
+    int count = int(millions * 1e6 / triangle_pack_width);
+    std::vector<query> queries;
+    std::vector<watertight_ray<real>> wrays;
+    queries.reserve(count);
+    wrays.reserve(count);
+    for(int i = 0; i < count; i++) {
+        int k = int(random_double() * packs.size());
+        const triangle& tri = tris[packs[k].first];
+        point3 target = (tri.p[0] + tri.p[1] + tri.p[2]) / 3 + 0.02 * random_in_unit_sphere();
+        point3 origin = 3 * random_unit_vector();
+        queries.push_back({ray(origin, target - origin), k});
+        wrays.emplace_back(queries.back().r);
+    }
+
+    size_t hits_mt = 0, hits_ws = 0, hits_wp = 0;
+    double checksum_mt = 0, checksum_ws = 0, checksum_wp = 0;
+
+    double time_mt = seconds([&] {
+        for(const auto& q : queries) {
+            const pack& pk = packs[q.pack];
+            interval ray_t(0, infinity);
+            bool hit = false;
+            real t, b1, b2;
+            for(int lane = 0; lane < pk.count; lane++) {
+                if(moller_trumbore(tris[pk.first + lane], q.r, ray_t, t, b1, b2)) {
+                    ray_t.max = t;
+                    hit = true;
+                }
+            }
+            hits_mt += hit;
+            checksum_mt += hit ? ray_t.max : 0;
+        }
+    });
+
+    double time_ws = seconds([&] {
+        for(size_t i = 0; i < queries.size(); i++) {
+            const pack& pk = packs[queries[i].pack];
+            interval ray_t(0, infinity);
+            bool hit = false;
+            real t, b1, b2;
+            for(int lane = 0; lane < pk.count; lane++) {
+                const triangle& tri = tris[pk.first + lane];
+                if(intersect_triangle(tri.p[0], tri.p[1], tri.p[2], wrays[i], ray_t, t, b1, b2)) {
+                    ray_t.max = t;
+                    hit = true;
+                }
+            }
+            hits_ws += hit;
+            checksum_ws += hit ? ray_t.max : 0;
+        }
+    });
+
+    double time_wp = seconds([&] {
+        for(size_t i = 0; i < queries.size(); i++) {
+            interval ray_t(0, infinity);
+            real t, b1, b2;
+            bool hit = packs[queries[i].pack].intersect(wrays[i], ray_t, t, b1, b2) >= 0;
+            hits_wp += hit;
+            checksum_wp += hit ? t : 0;
+        }
+    });
+
+    double tests = double(queries.size()) * triangle_pack_width;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << tris.size() << " triangles, " << triangle_pack_width << "-wide " << (sizeof(real) == 4 ? "float" : "double")
+              << " packs, " << queries.size() << " rays against one pack each\n";
+    std::cout << "  Moller-Trumbore (scalar): " << time_mt / tests * 1e9 << " ns/triangle, " << hits_mt << " hits, sum t " << checksum_mt << '\n';
+    std::cout << "  Watertight (scalar):      " << time_ws / tests * 1e9 << " ns/triangle, " << hits_ws << " hits, sum t " << checksum_ws << '\n';
+    std::cout << "  Watertight (pack):        " << time_wp / tests * 1e9 << " ns/triangle, " << hits_wp << " hits, sum t " << checksum_wp << '\n';
+    std::cout << "  Pack speedup: " << time_mt / time_wp << "x over Moller-Trumbore, " << time_ws / time_wp << "x over scalar watertight\n";
+
+    leak_test(sphere_triangles(64), make_packs(sphere_triangles(64)));
+    return 0;
+}
@@ -0,0 +1,73 @@
+// Path-at-a-time (megakernel) rendering vs the wavefront engine, with and without shading
+// grouped by material type and with bounce and shadow rays reordered for coherence, on scenes 1
+// and 3 (many materials of all types) and 12.
+// Build and run from src/ (like main.cc):
+//   g++ -std=c++17 -O2 -pthread Benchmarks/wavefront.cc -o wavefront
+//   ./wavefront [width] [spp] [runs] [threads]
+// Times are the best of 'runs' renders. Both engines trace the same random sequences, so their
+// images must be identical; a mismatch is reported.
+
+#include "bench.h"
+#include "ppm.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+struct config {
+    const char* name;
+    bool wavefront;
+    bool sort;
+    bool reorder;
+};
+
+int main(int argc, char** argv) {
+    int width   = argc > 1 ? atoi(argv[1]) : 200;
+    int spp     = argc > 2 ? atoi(argv[2]) : 16;
+    int runs    = argc > 3 ? atoi(argv[3]) : 3;
+    int threads = argc > 4 ? atoi(argv[4]) : 1;
+
+    const config configs[] = {
+        {"megakernel",             false, false, false},
+        {"wavefront",              true,  false, false},
+        {"wavefront + sorting",    true,  true,  false},
+        {"wavefront + reordering", true,  false, true},
+    };
+
+    std::cout << std::fixed << std::setprecision(3);
+    for(int scene : {1, 3, 12}) {
+        std::vector<int> reference;
+        for(const auto& c : configs) {
+            double best = infinity;
+            uint64_t rays = 0;
+            std::string output = "wavefront_scene" + std::to_string(scene) + ".ppm";
+            for(int run = 0; run < runs; run++) {
+                hittable_list world;
+                hittable_list lights;
+                camera cam;
+                setup_scene(scene, world, lights, cam, width, spp, scene == 12 ? 4 : 50);
+                cam.integrator = camera::iterative; // The wavefront engine's global illumination
+                cam.wavefront = c.wavefront;
+                cam.wavefront_sort = c.sort;
+                cam.wavefront_reorder = c.reorder;
+                cam.output = output;
+                best = std::min(best, timed_render(cam, world, lights, threads));
+                rays = cam.traced_rays();
+            }
+
+            std::vector<int> image;
+            if(!read_ppm(output, image)) {
+                std::cerr << "Cannot read back ../Rendered_Images/" << output << '\n';
+                return 1;
+            }
+            if(reference.empty())
+                reference = image;
+
+            std::cout << "Scene " << scene << ", " << c.name << ": " << best << " s, "
+                      << rays / best / 1e6 << " Mrays/s"
+                      << (image == reference ? "" : ", image differs from the megakernel") << '\n';
+        }
+    }
+    return 0;
+}
@@ -3,18 +3,22 @@
 
 #include "../Helper/rtweekend.h"
 
-class aabb {
+template <typename T>
+class aabb_t {
     public:
+        using interval = interval_t<T>;
+        using point = vec3_t<T>;
+
         interval x, y, z;
 
-        aabb() {} // Default is empty since Intervals empty by default
+        aabb_t() {} // Default is empty since Intervals empty by default
 
-        aabb(const interval& x, const interval& y, const interval& z)
+        aabb_t(const interval& x, const interval& y, const interval& z)
          : x(x), y(y), z(z) {
             pad_to_minimus();
          }
 
-        aabb(const point3& a, const point3& b) {
+        aabb_t(const point& a, const point& b) {
             // Treat a,b as extrema for bounding box, doesn't require min/max order
 
             x = (a[0] <= b[0]) ? interval(a[0], b[0]) : interval(b[0], a[0]);
@@ -24,7 +28,7 @@ class aabb {
             pad_to_minimus();
         }
 
-        aabb(const aabb& box0, const aabb& box1) {
+        aabb_t(const aabb_t& box0, const aabb_t& box1) {
             x = interval(box0.x, box1.x);
             y = interval(box0.y, box1.y);
             z = interval(box0.z, box1.z);
@@ -36,31 +40,43 @@ class aabb {
             return x;
         }
 
-        bool hit(const ray& r, interval ray_t) const {
-            const point3& ray_orig = r.origin();
-            const vec3&   ray_dir  = r.direction();
+        bool hit(const ray_t<T>& r, interval ray_t) const {
+            T t_enter;
+            return hit(r, ray_t, t_enter);
+        }
+
+        bool hit(const ray_t<T>& r, interval ray_t, T& t_enter) const {
+            // Slab test with the ray's precomputed reciprocal direction, the sign bits pick
+            // the near and far plane per axis. Sets t_enter to the entry distance.
+            const point&     ray_orig = r.origin();
+            const vec3_t<T>& ray_inv   = r.inv_direction();
 
             for(int axis = 0; axis < 3; axis++) {
                 const interval& ax = axis_interval(axis);
-                const double adinv = 1.0 / ray_dir[axis];
+                const bool neg = r.sign(axis);
 
-                auto t0 = (ax.min - ray_orig[axis]) * adinv;
-                auto t1 = (ax.max - ray_orig[axis]) * adinv;
+                auto t0 = ((neg ? ax.max : ax.min) - ray_orig[axis]) * ray_inv[axis];
+                auto t1 = ((neg ? ax.min : ax.max) - ray_orig[axis]) * ray_inv[axis] * far_scale;
 
-                if(t0 < t1) {
-                    if(t0 > ray_t.min) ray_t.min = t0;
-                    if(t1 < ray_t.max) ray_t.max = t1;
-                } else {
-                    if(t1 > ray_t.min) ray_t.min = t1;
-                    if(t0 < ray_t.max) ray_t.max = t0;
-                }
+                if(t0 > ray_t.min) ray_t.min = t0;
+                if(t1 < ray_t.max) ray_t.max = t1;
 
                 if(ray_t.max <= ray_t.min)
                     return false;
             }
+            t_enter = ray_t.min;
             return true;
         }
 
+        bool is_empty() const {
+            return x.min > x.max || y.min > y.max || z.min > z.max;
+        }
+
+        T surface_area() const {
+            auto dx = x.size(), dy = y.size(), dz = z.size();
+            return 2 * (dx*dy + dy*dz + dz*dx);
+        }
+
         int longest_axis() const {
             if(x.size() > y.size()) {
                 return x.size() > z.size() ? 0 : 2;
@@ -69,26 +85,46 @@ class aabb {
             }
         }
 
-        static const aabb empty, universe;
+        // Box at 'time' in [0, 1] of bounds that move linearly from 'open' to 'close'
+        static aabb_t lerp(const aabb_t& open, const aabb_t& close, T time) {
+            aabb_t box;
+            box.x = interval(open.x.min + time * (close.x.min - open.x.min), open.x.max + time * (close.x.max - open.x.max));
+            box.y = interval(open.y.min + time * (close.y.min - open.y.min), open.y.max + time * (close.y.max - open.y.max));
+            box.z = interval(open.z.min + time * (close.z.min - open.z.min), open.z.max + time * (close.z.max - open.z.max));
+            return box;
+        }
+
+        static const aabb_t empty, universe;
+
+        // Exit distances are scaled by this to bound their rounding error, 1 + 2*gamma(3) as in
+        // PBRT. Without it a thin slab far from the origin can round to t0 == t1 in float and miss.
+        static constexpr T far_scale = 1 + 2 * (3 * std::numeric_limits<T>::epsilon() / 2)
+                                             / (1 - 3 * std::numeric_limits<T>::epsilon() / 2);
 
     private:
         void pad_to_minimus() {
             //Padding for 2D Objects
-            double delta = 0.0001;
+            T delta = T(0.0001);
             if(x.size() < delta) x = x.expand(delta);
             if(y.size() < delta) y = y.expand(delta);
             if(z.size() < delta) z = z.expand(delta);
         }
 };
 
-const aabb aabb::empty    = aabb(interval::empty,    interval::empty,    interval::empty);
-const aabb aabb::universe = aabb(interval::universe, interval::universe, interval::universe);
+template <typename T>
+const aabb_t<T> aabb_t<T>::empty    = aabb_t<T>(interval_t<T>::empty,    interval_t<T>::empty,    interval_t<T>::empty);
+template <typename T>
+const aabb_t<T> aabb_t<T>::universe = aabb_t<T>(interval_t<T>::universe, interval_t<T>::universe, interval_t<T>::universe);
+
+using aabb = aabb_t<real>;
 
-aabb operator+(const aabb& bbox, const vec3& offset) {
-    return aabb(bbox.x + offset.x(), bbox.y + offset.y(), bbox.z + offset.z());
+template <typename T>
+inline aabb_t<T> operator+(const aabb_t<T>& bbox, const vec3_t<T>& offset) {
+    return aabb_t<T>(bbox.x + offset.x(), bbox.y + offset.y(), bbox.z + offset.z());
 }
 
-aabb operator+(const vec3& offset, const aabb& bbox) {
+template <typename T>
+inline aabb_t<T> operator+(const vec3_t<T>& offset, const aabb_t<T>& bbox) {
     return bbox + offset;
 }
 
@@ -9,25 +9,64 @@
 
 #include <algorithm>
 
+class bvh_options {
+    public:
+        enum split_method {median, sah};
+        enum node_layout {tree, linear, wide4, wide8};
+
+        split_method split = median; // Median object count along longest axis, or binned Surface Area Heuristic
+        node_layout layout = tree;   // Layout make_bvh() hands out: node tree, flattened node array or 4/8-wide SIMD nodes
+        int    bins              = 16;  // SAH: Centroid bins per axis
+        double traversal_cost    = 1.0; // SAH: Cost of visiting a node (one box test)
+        double intersection_cost = 1.0; // SAH: Cost of one primitive hit test
+        bool   report            = false; // Print object count and SAH cost after building
+        int    time_segments     = 1;   // make_bvh(): Shutter segments for fast moving objects, 1 = off
+        double fast_motion       = 1.25; // Swept over own box area above which a box is interpolated by time,
+                                         // and make_bvh() puts an object in the time segments
+};
+
+template <int N> class wide_bvh;
+
+inline uint64_t& bvh_nodes_visited() {
+    // Per-thread count of BVH nodes whose box was tested, for traversal statistics
+    thread_local uint64_t count = 0;
+    return count;
+}
+
 class bvh_node : public hittable {
     public:
-        bvh_node(hittable_list list) : bvh_node(list.objects, 0, list.objects.size()) {
+        // Used when no options are passed, e.g. by the scenes
+        inline static bvh_options default_options;
+
+        bvh_node(hittable_list list) : bvh_node(list, default_options) {}
+
+        bvh_node(hittable_list list, const bvh_options& options, double time0 = 0, double time1 = 1)
+         : bvh_node(list.objects, 0, list.objects.size(), options, time0, time1) {
             // Implicit copy of hittable_list, which we modify only during constructor lifetime
+            if(options.report) {
+                std::clog << "BVH (" << (options.split == bvh_options::sah ? "sah" : "median") << "): "
+                          << list.objects.size() << " objects, SAH cost " << sah << '\n';
+            }
         }
 
-        bvh_node(std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end) {
+        // Built for rays with times in [time0, time1]. Moving objects are bounded at both ends of
+        // the range and traversal interpolates the boxes to the ray's time.
+        bvh_node(std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end,
+                 const bvh_options& options = default_options, double time0 = 0, double time1 = 1)
+         : time0(time0), time1(time1), time_scale(1 / (time1 - time0)), fast_motion(options.fast_motion) {
             // Build bounding box of span of source objects
-            bbox = aabb::empty;
+            bbox_open = bbox_close = aabb::empty;
+            bool objects_moving = false;
             for(size_t object_index = start; object_index < end; object_index++) {
-                bbox = aabb(bbox, objects[object_index]->bounding_box());
+                aabb open, close;
+                objects_moving = objects[object_index]->motion_bounds(time0, time1, open, close) || objects_moving;
+                bbox_open = aabb(bbox_open, open);
+                bbox_close = aabb(bbox_close, close);
             }
-
-            int axis = bbox.longest_axis();
-            
-
-            auto comparator = (axis == 0) ? box_x_compare
-                            : (axis == 1) ? box_y_compare
-                                          : box_z_compare;
+            bbox = aabb(bbox_open, bbox_close);
+            moving = objects_moving && sweep_pays(bbox_open, bbox_close);
+            if(!moving)
+                bbox_open = bbox_close = bbox;
 
             size_t object_span = end - start;
 
@@ -37,51 +76,298 @@ class bvh_node : public hittable {
                 left = objects[start];
                 right = objects[start + 1];
             } else {
-                std::sort(objects.begin() + start, objects.begin() + end, comparator);
+                auto mid = (options.split == bvh_options::sah)
+                         ? sah_partition(objects, start, end, options)
+                         : median_partition(objects, start, end);
 
-                auto mid = start +  object_span/2;
-                left = make_shared<bvh_node>(objects, start, mid);
-                right = make_shared<bvh_node>(objects, mid, end);
+                left = make_shared<bvh_node>(objects, start, mid, options, time0, time1);
+                right = make_shared<bvh_node>(objects, mid, end, options, time0, time1);
+            }
+
+            // Child boxes and node pointers cached for traversal, avoids virtual calls per visit
+            left_moving = node_bounds(left.get(), left_box, left_close);
+            right_moving = node_bounds(right.get(), right_box, right_close);
+            left_node = dynamic_cast<const bvh_node*>(left.get());
+            right_node = dynamic_cast<const bvh_node*>(right.get());
+            any_moving = moving || left_moving || right_moving
+                      || (left_node && left_node->any_moving) || (right_node && right_node->any_moving);
+
+            // Expected cost of a ray that hits this node, children weighted by relative surface area
+            auto area = bbox.surface_area();
+            auto left_cost = object_cost(left, options);
+            auto right_cost = object_cost(right, options);
+            sah = options.traversal_cost;
+            if(area > 0) {
+                sah += (aabb(left_box, left_close).surface_area() * left_cost
+                      + aabb(right_box, right_close).surface_area() * right_cost) / area;
+            } else {
+                sah += left_cost + right_cost;
             }
             
             //bbox = aabb(left->bounding_box(), right->bounding_box());
         }
 
         bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-            if(!bbox.hit(r, ray_t))
+            // Node visits are counted locally and added to the thread's counter once per traversal
+            real t_enter;
+            if(!box_hit(bbox_open, bbox_close, moving, r, ray_t, t_enter)) {
+                bvh_nodes_visited()++;
                 return false;
+            }
 
-            bool hit_left = left->hit(r, ray_t, rec);
-            bool hit_right = right->hit(r, interval(ray_t.min, hit_left ? rec.t : ray_t.max), rec);
+            int visited = 1;
+            bool found = hit_children(r, ray_t, rec, visited);
+            bvh_nodes_visited() += visited;
+            return found;
+        }
 
-            return hit_left || hit_right;
+        bool occluded(const ray& r, interval ray_t) const override {
+            real t_enter;
+            if(!box_hit(bbox_open, bbox_close, moving, r, ray_t, t_enter)) {
+                bvh_nodes_visited()++;
+                return false;
+            }
+
+            int visited = 1;
+            bool found = occluded_children(r, ray_t, visited);
+            bvh_nodes_visited() += visited;
+            return found;
         }
 
         aabb bounding_box() const override {return bbox;}
+
+        bool motion_bounds(double t0, double t1, aabb& open, aabb& close) const override {
+            if(!moving)
+                return hittable::motion_bounds(t0, t1, open, close);
+            open = aabb::lerp(bbox_open, bbox_close, real((t0 - time0) * time_scale));
+            close = aabb::lerp(bbox_open, bbox_close, real((t1 - time0) * time_scale));
+            return true;
+        }
+
+        // SAH cost of the subtree with the options it was built with
+        double sah_cost() const {return sah;}
+
+        // Bounds of 'object' at both ends of the node's time range, as traversal should test them.
+        // Boxes that sweep little are kept still as their union: interpolating them on every visit
+        // costs more than the few box hits it saves.
+        bool node_bounds(const hittable* object, aabb& open, aabb& close) const {
+            if(object->motion_bounds(time0, time1, open, close) && sweep_pays(open, close))
+                return true;
+            open = close = aabb(open, close);
+            return false;
+        }
+
     private:
+        friend class linear_bvh;
+        template <int N> friend class wide_bvh;
+
         shared_ptr<hittable> left;
         shared_ptr<hittable> right;
-        aabb bbox;
+        aabb bbox;                    // Over the whole time range
+        aabb bbox_open, bbox_close;   // At time0 and time1
+        aabb left_box, right_box;     // Children at time0
+        aabb left_close, right_close; // Children at time1
+        const bvh_node* left_node;
+        const bvh_node* right_node;
+        double sah;
+        double time0, time1, time_scale;
+        double fast_motion;
+        bool moving;                    // Own box is interpolated by ray time
+        bool left_moving, right_moving; // Children boxes are
+        bool any_moving;                // Some box in the subtree is
+
+        bool sweep_pays(const aabb& open, const aabb& close) const {
+            return aabb(open, close).surface_area() > fast_motion * (open.surface_area() + close.surface_area()) / 2;
+        }
+
+        bool box_hit(
+            const aabb& open, const aabb& close, bool moves, const ray& r, const interval& ray_t, real& t_enter
+        ) const {
+            if(!moves)
+                return open.hit(r, ray_t, t_enter);
+            return aabb::lerp(open, close, real((r.time() - time0) * time_scale)).hit(r, ray_t, t_enter);
+        }
+
+        bool hit_children(const ray& r, interval ray_t, hit_record& rec, int& visited) const {
+            // Front-to-back: visit the child whose box the ray enters first, and skip the
+            // other one if the closest hit so far lies in front of its entry point
+            if(left == right)
+                return hit_child(left, left_node, r, ray_t, rec, visited);
+
+            real t_left = infinity, t_right = infinity;
+            visited += 2;
+            bool in_left = box_hit(left_box, left_close, left_moving, r, ray_t, t_left);
+            bool in_right = box_hit(right_box, right_close, right_moving, r, ray_t, t_right);
+
+            if(!in_left && !in_right)
+                return false;
+            if(!in_right)
+                return hit_child(left, left_node, r, ray_t, rec, visited);
+            if(!in_left)
+                return hit_child(right, right_node, r, ray_t, rec, visited);
 
-        static bool box_compare(
-            const shared_ptr<hittable> a, const shared_ptr<hittable> b, int axis_index
+            bool left_first = t_left <= t_right;
+            const auto& first = left_first ? left : right;
+            const auto& second = left_first ? right : left;
+            auto first_node = left_first ? left_node : right_node;
+            auto second_node = left_first ? right_node : left_node;
+            auto t_second = left_first ? t_right : t_left;
+
+            bool hit_first = hit_child(first, first_node, r, ray_t, rec, visited);
+            if(hit_first) {
+                if(rec.t < t_second)
+                    return true;
+                ray_t.max = rec.t;
+            }
+            return hit_child(second, second_node, r, ray_t, rec, visited) || hit_first;
+        }
+
+        bool occluded_children(const ray& r, const interval& ray_t, int& visited) const {
+            // No order needed, the first blocker in either child ends the search
+            if(left == right)
+                return occluded_child(left, left_node, r, ray_t, visited);
+
+            real t_enter;
+            visited++;
+            if(box_hit(left_box, left_close, left_moving, r, ray_t, t_enter) && occluded_child(left, left_node, r, ray_t, visited))
+                return true;
+            visited++;
+            return box_hit(right_box, right_close, right_moving, r, ray_t, t_enter)
+                && occluded_child(right, right_node, r, ray_t, visited);
+        }
+
+        static bool occluded_child(
+            const shared_ptr<hittable>& child, const bvh_node* node, const ray& r, const interval& ray_t, int& visited
         ) {
-            auto a_axis_interval = a->bounding_box().axis_interval(axis_index);
-            auto b_axis_interval = b->bounding_box().axis_interval(axis_index);
-            return a_axis_interval.min < b_axis_interval.min;
+            return node ? node->occluded_children(r, ray_t, visited) : child->occluded(r, ray_t);
+        }
+
+        static bool hit_child(
+            const shared_ptr<hittable>& child, const bvh_node* node, const ray& r, interval ray_t, hit_record& rec,
+            int& visited
+        ) {
+            // Box of a child node was already tested by its parent
+            return node ? node->hit_children(r, ray_t, rec, visited) : child->hit(r, ray_t, rec);
+        }
+
+        size_t median_partition(std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end) const {
+            int axis = bbox.longest_axis();
+
+            std::sort(objects.begin() + start, objects.begin() + end,
+                [&](const shared_ptr<hittable>& a, const shared_ptr<hittable>& b) {
+                    return box_compare(a, b, axis);
+                });
+
+            return start + (end - start)/2;
+        }
+
+        size_t sah_partition(
+            std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end, const bvh_options& options
+        ) const {
+            // Binned SAH: bin the object centroids along each axis and evaluate the
+            // split cost at every bin border, keep the cheapest one
+            struct bin {
+                aabb box;
+                int count = 0;
+            };
+
+            interval centroid_bounds[3];
+            for(size_t i = start; i < end; i++) {
+                auto c = centroid(object_box(objects[i]));
+                for(int axis = 0; axis < 3; axis++)
+                    centroid_bounds[axis] = interval(centroid_bounds[axis], interval(c[axis], c[axis]));
+            }
+
+            int bin_count = options.bins < 2 ? 2 : options.bins;
+            std::vector<bin> bins(bin_count);
+            std::vector<double> right_area(bin_count);
+            std::vector<int> right_count(bin_count);
+
+            int best_axis = -1;
+            int best_border = 0;
+            double best_cost = infinity;
+
+            for(int axis = 0; axis < 3; axis++) {
+                const interval& extent = centroid_bounds[axis];
+                if(extent.size() <= 0)
+                    continue;
+
+                std::fill(bins.begin(), bins.end(), bin());
+                for(size_t i = start; i < end; i++) {
+                    auto box = object_box(objects[i]);
+                    auto& b = bins[bin_index(centroid(box)[axis], extent, bin_count)];
+                    b.box = aabb(b.box, box);
+                    b.count++;
+                }
+
+                // Sweep from the right, then from the left, splitting after bin 'border'
+                aabb acc = aabb::empty;
+                int count = 0;
+                for(int border = bin_count - 1; border > 0; border--) {
+                    acc = aabb(acc, bins[border].box);
+                    count += bins[border].count;
+                    right_area[border] = count ? acc.surface_area() : 0;
+                    right_count[border] = count;
+                }
+
+                acc = aabb::empty;
+                count = 0;
+                for(int border = 1; border < bin_count; border++) {
+                    acc = aabb(acc, bins[border - 1].box);
+                    count += bins[border - 1].count;
+                    if(count == 0 || right_count[border] == 0)
+                        continue;
+
+                    double cost = acc.surface_area() * count + right_area[border] * right_count[border];
+                    if(cost < best_cost) {
+                        best_cost = cost;
+                        best_axis = axis;
+                        best_border = border;
+                    }
+                }
+            }
+
+            // All centroids coincide, nothing to separate
+            if(best_axis < 0)
+                return median_partition(objects, start, end);
+
+            const interval& extent = centroid_bounds[best_axis];
+            auto mid = std::partition(objects.begin() + start, objects.begin() + end,
+                [&](const shared_ptr<hittable>& object) {
+                    return bin_index(centroid(object_box(object))[best_axis], extent, bin_count) < best_border;
+                });
+
+            return size_t(mid - objects.begin());
         }
 
-        static bool box_x_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b) {
-            return box_compare(a, b, 0);
+        static double object_cost(const shared_ptr<hittable>& object, const bvh_options& options) {
+            // Nested BVHs (e.g. a bvh_node inside the scene list) bring their own cost
+            auto node = std::dynamic_pointer_cast<bvh_node>(object);
+            return node ? node->sah : options.intersection_cost;
         }
 
-        static bool box_y_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b) {
-            return box_compare(a, b, 1);
+        static point3 centroid(const aabb& box) {
+            return point3(box.x.min + box.x.max, box.y.min + box.y.max, box.z.min + box.z.max) / 2;
         }
 
-        static bool box_z_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b) {
-            return box_compare(a, b, 2);
+        static int bin_index(double c, const interval& extent, int bin_count) {
+            int index = int(bin_count * (c - extent.min) / extent.size());
+            return index < 0 ? 0 : (index >= bin_count ? bin_count - 1 : index);
+        }
+
+        aabb object_box(const shared_ptr<hittable>& object) const {
+            // Bounds over the node's time range, the whole box for still objects
+            aabb open, close;
+            if(!object->motion_bounds(time0, time1, open, close))
+                return open;
+            return aabb(open, close);
+        }
+
+        bool box_compare(const shared_ptr<hittable>& a, const shared_ptr<hittable>& b, int axis_index) const {
+            auto a_axis_interval = object_box(a).axis_interval(axis_index);
+            auto b_axis_interval = object_box(b).axis_interval(axis_index);
+            return a_axis_interval.min < b_axis_interval.min;
         }
 };
 
-#endif
\ No newline at end of file
+#endif
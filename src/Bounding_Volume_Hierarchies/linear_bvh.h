@@ -0,0 +1,273 @@
+#ifndef LINEAR_BVH_H
+#define LINEAR_BVH_H
+
+#include "../Helper/rtweekend.h"
+
+#include "aabb.h"
+#include "bvh.h"
+#include "../Hittable/hittable.h"
+
+#include <cstdint>
+#include <vector>
+
+// Flattened copy of a finished bvh_node tree: one array of 32 byte nodes in depth-first
+// order (left child directly after its parent) and one array of raw primitive pointers.
+// Traversal is a loop over node indices, no virtual calls or refcounts until a leaf.
+// Nodes over moving objects keep how far their bounds move over the time range in a second
+// array and are moved to the ray's time before the test; still nodes are tested as they are.
+class linear_bvh : public hittable {
+    public:
+        struct alignas(32) node {
+            float    bmin[3], bmax[3]; // Bounds, rounded outwards to float
+            int32_t  offset;           // Leaf: first primitive, interior: index of right child
+            uint16_t count;            // Primitives in leaf, 0 for interior nodes
+            uint16_t moving;           // Bounds move by motion[] over the time range
+        };
+
+        static const int stack_size = 64;
+
+        linear_bvh(shared_ptr<bvh_node> tree, bool report = bvh_node::default_options.report)
+         : tree(tree), bbox(tree->bounding_box()), time0(tree->time0), time_scale(tree->time_scale) {
+            // 'tree' keeps the primitives alive, prims only borrows them
+            size_t tree_bytes = 0;
+            flatten(tree.get(), 0, tree_bytes);
+
+            if(report) {
+                std::clog << "Linear BVH: " << nodes.size() << " nodes, " << prims.size() << " primitives, "
+                          << memory_footprint() << " bytes (tree: " << tree_bytes << " bytes)\n";
+            }
+        }
+
+        bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+            // Children boxes are tested at their parent; the nearer child is visited first and
+            // the farther one is pushed with its entry distance, so it can be culled on pop
+            // once a closer hit is known
+            struct entry {
+                int index;
+                double t;
+            };
+            entry stack[stack_size];
+            int top = 0;
+            double t_enter;
+            uint64_t visited = 1;
+            bool hit_anything = false;
+
+            auto time = float((r.time() - time0) * time_scale);
+            int current = node_hit(0, r, time, ray_t, t_enter) ? 0 : -1;
+
+            while(current >= 0) {
+                const node& n = nodes[current];
+
+                if(n.count > 0) {
+                    for(int i = 0; i < n.count; i++) {
+                        if(prims[n.offset + i]->hit(r, ray_t, rec)) {
+                            hit_anything = true;
+                            ray_t.max = rec.t;
+                        }
+                    }
+                    current = -1;
+                } else {
+                    // Left child follows its parent
+                    int a = current + 1;
+                    int b = n.offset;
+                    double t_a, t_b;
+                    bool in_a = node_hit(a, r, time, ray_t, t_a);
+                    bool in_b = node_hit(b, r, time, ray_t, t_b);
+                    visited += 2;
+
+                    if(in_a && in_b) {
+                        if(t_b < t_a) {
+                            std::swap(a, b);
+                            std::swap(t_a, t_b);
+                        }
+                        stack[top++] = {b, t_b};
+                        current = a;
+                    } else {
+                        current = in_a ? a : (in_b ? b : -1);
+                    }
+                }
+
+                while(current < 0 && top > 0) {
+                    const entry& e = stack[--top];
+                    if(e.t < ray_t.max)
+                        current = e.index;
+                }
+            }
+
+            bvh_nodes_visited() += visited;
+            return hit_anything;
+        }
+
+        bool occluded(const ray& r, interval ray_t) const override {
+            // hit() without the ordering: the far child is whichever comes second, and the
+            // first blocker ends the traversal
+            int stack[stack_size];
+            int top = 0;
+            double t_enter;
+            uint64_t visited = 1;
+            bool blocked = false;
+
+            auto time = float((r.time() - time0) * time_scale);
+            int current = node_hit(0, r, time, ray_t, t_enter) ? 0 : -1;
+
+            while(current >= 0 && !blocked) {
+                const node& n = nodes[current];
+
+                if(n.count > 0) {
+                    for(int i = 0; i < n.count && !blocked; i++)
+                        blocked = prims[n.offset + i]->occluded(r, ray_t);
+                    current = -1;
+                } else {
+                    int a = current + 1;
+                    int b = n.offset;
+                    bool in_a = node_hit(a, r, time, ray_t, t_enter);
+                    bool in_b = node_hit(b, r, time, ray_t, t_enter);
+                    visited += 2;
+
+                    if(in_a && in_b)
+                        stack[top++] = b;
+                    current = in_a ? a : (in_b ? b : -1);
+                }
+
+                if(current < 0 && top > 0)
+                    current = stack[--top];
+            }
+
+            bvh_nodes_visited() += visited;
+            return blocked;
+        }
+
+        aabb bounding_box() const override {return bbox;}
+
+        size_t memory_footprint() const {
+            return (nodes.size() + motion.size()) * sizeof(node) + prims.size() * sizeof(const hittable*);
+        }
+
+        bool motion_bounds(double t0, double t1, aabb& open, aabb& close) const override {
+            return tree->motion_bounds(t0, t1, open, close);
+        }
+
+        // Node bounds and slab test, also used by the BVH of triangle_mesh
+        static void set_bounds(node& n, const aabb& box) {
+            for(int axis = 0; axis < 3; axis++) {
+                const interval& ax = box.axis_interval(axis);
+                n.bmin[axis] = round_down(ax.min);
+                n.bmax[axis] = round_up(ax.max);
+            }
+        }
+
+        static bool box_hit(const node& n, const ray& r, interval ray_t, double& t_enter) {
+            const point3& ray_orig = r.origin();
+            const vec3&   ray_inv  = r.inv_direction();
+
+            for(int axis = 0; axis < 3; axis++) {
+                const bool neg = r.sign(axis);
+
+                auto t0 = ((neg ? n.bmax[axis] : n.bmin[axis]) - ray_orig[axis]) * ray_inv[axis];
+                auto t1 = ((neg ? n.bmin[axis] : n.bmax[axis]) - ray_orig[axis]) * ray_inv[axis] * aabb::far_scale;
+
+                if(t0 > ray_t.min) ray_t.min = t0;
+                if(t1 < ray_t.max) ray_t.max = t1;
+
+                if(ray_t.max <= ray_t.min)
+                    return false;
+            }
+            t_enter = ray_t.min;
+            return true;
+        }
+
+    private:
+        shared_ptr<bvh_node> tree;
+        std::vector<node> nodes;
+        std::vector<node> motion; // Bounds at time1 minus bounds at time0, empty if nothing moves
+        std::vector<const hittable*> prims;
+        aabb bbox;
+        double time0, time_scale;
+
+        bool node_hit(int index, const ray& r, float time, const interval& ray_t, double& t_enter) const {
+            const node& n = nodes[index];
+            if(!n.moving)
+                return box_hit(n, r, ray_t, t_enter);
+
+            node at = n;
+            const node& m = motion[index];
+            for(int axis = 0; axis < 3; axis++) {
+                at.bmin[axis] += time * m.bmin[axis];
+                at.bmax[axis] += time * m.bmax[axis];
+            }
+            return box_hit(at, r, ray_t, t_enter);
+        }
+
+        int flatten(const hittable* object, int depth, size_t& tree_bytes) {
+            auto index = int(nodes.size());
+            nodes.push_back(node());
+            aabb open, close;
+            bool moving = tree->node_bounds(object, open, close);
+            set_bounds(nodes[index], open);
+            if(moving) {
+                nodes[index].moving = 1;
+                motion.resize(nodes.size());
+                set_bounds(motion[index], close);
+                for(int axis = 0; axis < 3; axis++) {
+                    motion[index].bmin[axis] -= nodes[index].bmin[axis];
+                    motion[index].bmax[axis] -= nodes[index].bmax[axis];
+                }
+            }
+
+            auto bvh = dynamic_cast<const bvh_node*>(object);
+            if(bvh)
+                tree_bytes += sizeof(bvh_node) + 2 * sizeof(void*); // Node plus make_shared control block
+
+            if(bvh && depth < stack_size - 1) {
+                auto left = dynamic_cast<const bvh_node*>(bvh->left.get());
+                auto right = dynamic_cast<const bvh_node*>(bvh->right.get());
+
+                if(!left && !right) {
+                    // Both children are primitives (the same one for single-object nodes)
+                    nodes[index].offset = int(prims.size());
+                    prims.push_back(bvh->left.get());
+                    if(bvh->right != bvh->left)
+                        prims.push_back(bvh->right.get());
+                    nodes[index].count = uint16_t(prims.size() - nodes[index].offset);
+                    return index;
+                }
+
+                flatten(bvh->left.get(), depth + 1, tree_bytes);
+                nodes[index].offset = flatten(bvh->right.get(), depth + 1, tree_bytes);
+                nodes[index].count = 0;
+                return index;
+            }
+
+            // Primitive (or a subtree too deep for the traversal stack) as a single-entry leaf
+            nodes[index].offset = int(prims.size());
+            nodes[index].count = 1;
+            prims.push_back(object);
+            if(bvh)
+                count_tree(bvh, tree_bytes);
+            return index;
+        }
+
+        static void count_tree(const bvh_node* bvh, size_t& tree_bytes) {
+            for(auto child : {bvh->left.get(), bvh->right.get()}) {
+                auto node = dynamic_cast<const bvh_node*>(child);
+                if(node) {
+                    tree_bytes += sizeof(bvh_node) + 2 * sizeof(void*);
+                    count_tree(node, tree_bytes);
+                }
+            }
+        }
+
+        static float round_down(double x) {
+            float f = float(x);
+            return (double(f) > x) ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+        }
+
+        static float round_up(double x) {
+            float f = float(x);
+            return (double(f) < x) ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+        }
+};
+
+static_assert(sizeof(linear_bvh::node) == 32, "linear_bvh::node must stay 32 bytes");
+
+#endif
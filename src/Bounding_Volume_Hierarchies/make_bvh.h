@@ -0,0 +1,57 @@
+#ifndef MAKE_BVH_H
+#define MAKE_BVH_H
+
+#include "../Helper/rtweekend.h"
+
+#include "bvh.h"
+#include "linear_bvh.h"
+#include "wide_bvh.h"
+#include "segmented_bvh.h"
+
+// Builds a BVH over 'list' in the layout selected by options.layout, for rays with times in
+// [time0, time1]. With options.time_segments > 1, fast moving objects get one BVH per segment.
+inline shared_ptr<hittable> make_bvh(hittable_list list, const bvh_options& options = bvh_node::default_options,
+                                     double time0 = 0, double time1 = 1) {
+    if(options.time_segments > 1) {
+        // Fast: the box swept over the shutter is much larger than the object's own box
+        hittable_list slow, fast;
+        for(const auto& object : list.objects) {
+            aabb open, close;
+            bool moving = object->motion_bounds(time0, time1, open, close);
+            double own_area = (open.surface_area() + close.surface_area()) / 2;
+            if(moving && aabb(open, close).surface_area() > options.fast_motion * own_area)
+                fast.add(object);
+            else
+                slow.add(object);
+        }
+
+        if(!fast.objects.empty()) {
+            auto segment_options = options;
+            segment_options.time_segments = 1;
+            int count = options.time_segments;
+            std::vector<shared_ptr<hittable>> segments;
+            for(int k = 0; k < count; k++) {
+                double t0 = time0 + (time1 - time0) * k / count;
+                double t1 = time0 + (time1 - time0) * (k + 1) / count;
+                segments.push_back(make_bvh(fast, segment_options, t0, t1));
+            }
+            auto still = slow.objects.empty() ? nullptr : make_bvh(slow, segment_options, time0, time1);
+
+            if(options.report) {
+                std::clog << "Time segments: " << count << " x " << fast.objects.size() << " fast objects, "
+                          << slow.objects.size() << " others\n";
+            }
+            return make_shared<segmented_bvh>(still, segments, time0, time1);
+        }
+    }
+
+    auto tree = make_shared<bvh_node>(list, options, time0, time1);
+    switch(options.layout) {
+        case bvh_options::linear: return make_shared<linear_bvh>(tree, options.report);
+        case bvh_options::wide4:  return make_shared<wide_bvh<4>>(tree, options.report);
+        case bvh_options::wide8:  return make_shared<wide_bvh<8>>(tree, options.report);
+        default:                  return tree;
+    }
+}
+
+#endif
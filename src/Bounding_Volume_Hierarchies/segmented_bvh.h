@@ -0,0 +1,69 @@
+#ifndef SEGMENTED_BVH_H
+#define SEGMENTED_BVH_H
+
+#include "../Helper/rtweekend.h"
+
+#include "aabb.h"
+#include "../Hittable/hittable.h"
+
+#include <vector>
+
+// Objects that sweep far during the shutter interval, split across time segments: segment k of
+// K is a BVH built for the k-th K-th of [time0, time1], so its boxes only bound that part of
+// each path.
+// A ray visits the BVH of the still (or slow) objects and the one segment its time falls in.
+class segmented_bvh : public hittable {
+    public:
+        segmented_bvh(shared_ptr<hittable> still, std::vector<shared_ptr<hittable>> segments,
+                      double time0 = 0, double time1 = 1)
+         : still(still), segments(segments), time0(time0), time_scale(segments.size() / (time1 - time0)) {
+            bbox = still ? still->bounding_box() : aabb::empty;
+            for(const auto& segment : segments)
+                bbox = aabb(bbox, segment->bounding_box());
+        }
+
+        bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+            bool hit_anything = false;
+            if(still && still->hit(r, ray_t, rec)) {
+                hit_anything = true;
+                ray_t.max = rec.t;
+            }
+
+            return segment(r.time())->hit(r, ray_t, rec) || hit_anything;
+        }
+
+        bool occluded(const ray& r, interval ray_t) const override {
+            return (still && still->occluded(r, ray_t)) || segment(r.time())->occluded(r, ray_t);
+        }
+
+        aabb bounding_box() const override {return bbox;}
+
+        bool motion_bounds(double t0, double t1, aabb& open, aabb& close) const override {
+            // The segments are only valid for their own times: their whole boxes, on top of the
+            // interpolated still part
+            aabb swept = aabb::empty;
+            for(const auto& segment : segments)
+                swept = aabb(swept, segment->bounding_box());
+            if(still)
+                still->motion_bounds(t0, t1, open, close);
+            else
+                open = close = aabb::empty;
+            open = aabb(open, swept);
+            close = aabb(close, swept);
+            return true;
+        }
+
+    private:
+        shared_ptr<hittable> still;
+        std::vector<shared_ptr<hittable>> segments;
+        double time0, time_scale; // Ray time to segment index
+        aabb bbox;
+
+        const hittable* segment(double time) const {
+            int k = int((time - time0) * time_scale);
+            k = k < 0 ? 0 : (k >= int(segments.size()) ? int(segments.size()) - 1 : k);
+            return segments[k].get();
+        }
+};
+
+#endif
@@ -0,0 +1,483 @@
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+#include "../Helper/rtweekend.h"
+
+#include "aabb.h"
+#include "bvh.h"
+#include "../Hittable/hittable.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+// N-ary BVH (N = 4 or 8) collapsed from a finished bvh_node tree. Every node keeps the
+// bounds of its N children in structure-of-arrays form, so one SSE (N = 4) or AVX (N = 8)
+// slab test checks the ray against all children at once. Other targets use a scalar loop.
+// If the tree interpolates any box by time, a second node array keeps how far each child bound moves
+// over the time range, and the slab test first moves the bounds to the ray's time.
+template <int N>
+class wide_bvh : public hittable {
+    static_assert(N == 4 || N == 8, "wide_bvh supports 4 or 8 children per node");
+
+    public:
+        struct alignas(32) node {
+            float   bounds[2][3][N]; // [min, max][axis][child], empty slots hold an inverted box
+            int32_t child[N];        // >= 0: node index, < 0: primitive ~child
+        };
+
+        static const int max_depth = 64;
+
+        wide_bvh(shared_ptr<bvh_node> tree, bool report = bvh_node::default_options.report)
+         : tree(tree), bbox(tree->bounding_box()), moving(tree->any_moving), time0(tree->time0), time_scale(tree->time_scale) {
+            // 'tree' keeps the primitives alive, prims only borrows them
+            auto root = tree.get();
+            if(root->left == root->right) {
+                // Single object, still needs a node around it
+                add_node();
+                set_child(0, 0, root->left.get(), 0);
+            } else {
+                collapse(root, 0);
+            }
+
+            if(report) {
+                std::clog << "Wide BVH" << N << ": " << nodes.size() << " nodes, " << prims.size() << " primitives, "
+                          << memory_footprint() << " bytes\n";
+            }
+        }
+
+        bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+            // Stack entries are child references with their entry distance, sorted so
+            // the nearest child is popped first. Farther ones are culled once a closer hit exists.
+            struct entry {
+                int32_t child;
+                float t;
+            };
+            entry stack[max_depth * (N - 1) + 1];
+            int top = 0;
+            uint64_t visited = 0;
+            bool hit_anything = false;
+
+            packed_ray pr(r);
+            auto time = float((r.time() - time0) * time_scale);
+            stack[top++] = {0, float(ray_t.min)};
+
+            while(top > 0) {
+                const entry e = stack[--top];
+                if(e.t > ray_t.max)
+                    continue;
+
+                if(e.child < 0) {
+                    if(prims[~e.child]->hit(r, ray_t, rec)) {
+                        hit_anything = true;
+                        ray_t.max = rec.t;
+                    }
+                    continue;
+                }
+
+                const node& n = nodes[e.child];
+                float t_enter[N];
+                int mask = box_mask(n, moving ? &motion[e.child] : nullptr, time, pr, ray_t, t_enter);
+                visited += N;
+
+                // Insertion sort of the hit children by decreasing entry distance
+                int first = top;
+                for(int k = 0; k < N; k++) {
+                    if(!(mask & (1 << k)))
+                        continue;
+                    int i = top++;
+                    while(i > first && stack[i - 1].t < t_enter[k]) {
+                        stack[i] = stack[i - 1];
+                        i--;
+                    }
+                    stack[i] = {n.child[k], t_enter[k]};
+                }
+            }
+
+            bvh_nodes_visited() += visited;
+            return hit_anything;
+        }
+
+        bool occluded(const ray& r, interval ray_t) const override {
+            // Unordered: hit children are pushed as they come, the first blocker ends the traversal
+            int32_t stack[max_depth * (N - 1) + 1];
+            int top = 0;
+            uint64_t visited = 0;
+            bool blocked = false;
+
+            packed_ray pr(r);
+            auto time = float((r.time() - time0) * time_scale);
+            stack[top++] = 0;
+
+            while(top > 0 && !blocked) {
+                int32_t child = stack[--top];
+                if(child < 0) {
+                    blocked = prims[~child]->occluded(r, ray_t);
+                    continue;
+                }
+
+                const node& n = nodes[child];
+                float t_enter[N];
+                int mask = box_mask(n, moving ? &motion[child] : nullptr, time, pr, ray_t, t_enter);
+                visited += N;
+                for(int k = 0; k < N; k++) {
+                    if(mask & (1 << k))
+                        stack[top++] = n.child[k];
+                }
+            }
+
+            bvh_nodes_visited() += visited;
+            return blocked;
+        }
+
+        void hit_packet(ray_packet& packet, double t_min) const override {
+            // Packet traversal: a child is culled for the whole packet when the interval
+            // bounds of the packet's directions miss its box. Primitives are then tested
+            // only by the rays whose own slab test passes. The rays of a packet have their own
+            // times, so moving trees trace them one by one.
+            packet_bounds pb;
+            if(moving || !pb.build(packet)) {
+                hittable::hit_packet(packet, t_min);
+                return;
+            }
+
+            struct entry {
+                int32_t node;
+                int32_t slot;
+                double t;
+            };
+            entry stack[max_depth * (N - 1) + 1];
+            int top = 0;
+            uint64_t visited = 0;
+            bool active[ray_packet::max_size];
+            std::copy(packet.active, packet.active + packet.size, active);
+
+            double packet_t_max = pb.t_max(packet, active);
+            stack[top++] = {-1, 0, t_min};
+
+            while(top > 0) {
+                const entry e = stack[--top];
+                if(e.t > packet_t_max)
+                    continue;
+
+                int32_t child = (e.node < 0) ? 0 : nodes[e.node].child[e.slot];
+
+                if(child < 0) {
+                    // Per-ray box test in front of the primitive
+                    const node& n = nodes[e.node];
+                    bool any = false;
+                    for(int i = 0; i < packet.size; i++) {
+                        packet.active[i] = active[i] && slot_hit(n, e.slot, packet.rays[i], t_min, packet.t_max[i]);
+                        any |= packet.active[i];
+                    }
+                    if(any) {
+                        prims[~child]->hit_packet(packet, t_min);
+                        packet_t_max = pb.t_max(packet, active);
+                    }
+                    continue;
+                }
+
+                const node& n = nodes[child];
+                double t_enter[N];
+                visited += N;
+
+                int first = top;
+                for(int k = 0; k < N; k++) {
+                    if(!pb.box_hit(n, k, t_min, packet_t_max, t_enter[k]))
+                        continue;
+                    int i = top++;
+                    while(i > first && stack[i - 1].t < t_enter[k]) {
+                        stack[i] = stack[i - 1];
+                        i--;
+                    }
+                    stack[i] = {child, k, t_enter[k]};
+                }
+            }
+
+            std::copy(active, active + packet.size, packet.active);
+            bvh_nodes_visited() += visited;
+        }
+
+        aabb bounding_box() const override {return bbox;}
+
+        size_t memory_footprint() const {
+            return (nodes.size() + motion.size()) * sizeof(node) + prims.size() * sizeof(const hittable*);
+        }
+
+        bool motion_bounds(double t0, double t1, aabb& open, aabb& close) const override {
+            return tree->motion_bounds(t0, t1, open, close);
+        }
+
+    private:
+        shared_ptr<bvh_node> tree;
+        std::vector<node> nodes;
+        std::vector<node> motion; // Bounds at time1 minus bounds at time0, only if something moves
+        std::vector<const hittable*> prims;
+        aabb bbox;
+        bool moving;
+        double time0, time_scale;
+
+        struct packed_ray {
+            float orig[3];
+            float inv[3];
+            int   sign[3];
+
+            packed_ray(const ray& r) {
+                for(int axis = 0; axis < 3; axis++) {
+                    orig[axis] = float(r.origin()[axis]);
+                    inv[axis] = float(r.inv_direction()[axis]);
+                    sign[axis] = r.sign(axis);
+                }
+            }
+        };
+
+        struct packet_bounds {
+            // Interval bounds over the packet: shared origin and per-axis range of the
+            // reciprocal directions. Only valid for rays from one origin whose direction
+            // signs agree on an axis; axes where they don't are not used for culling.
+            point3 orig;
+            double inv_lo[3], inv_hi[3];
+            bool   usable[3];
+            int    sign[3];
+
+            bool build(const ray_packet& packet) {
+                int first = -1;
+                for(int i = 0; i < packet.size && first < 0; i++)
+                    if(packet.active[i]) first = i;
+                if(first < 0)
+                    return false;
+
+                orig = packet.rays[first].origin();
+                for(int axis = 0; axis < 3; axis++) {
+                    inv_lo[axis] = inv_hi[axis] = packet.rays[first].inv_direction()[axis];
+                    sign[axis] = packet.rays[first].sign(axis);
+                    usable[axis] = true;
+                }
+
+                for(int i = 0; i < packet.size; i++) {
+                    if(!packet.active[i])
+                        continue;
+                    const ray& r = packet.rays[i];
+                    const point3& o = r.origin();
+                    if(o.x() != orig.x() || o.y() != orig.y() || o.z() != orig.z())
+                        return false;
+                    for(int axis = 0; axis < 3; axis++) {
+                        double inv = r.inv_direction()[axis];
+                        usable[axis] = usable[axis] && r.sign(axis) == sign[axis] && std::isfinite(inv);
+                        inv_lo[axis] = fmin(inv_lo[axis], inv);
+                        inv_hi[axis] = fmax(inv_hi[axis], inv);
+                    }
+                }
+                return true;
+            }
+
+            static double t_max(const ray_packet& packet, const bool* active) {
+                double t = -infinity;
+                for(int i = 0; i < packet.size; i++)
+                    if(active[i]) t = fmax(t, packet.t_max[i]);
+                return t;
+            }
+
+            bool box_hit(const node& n, int k, double t_min, double t_max, double& t_enter) const {
+                // Lower bound of the entry and upper bound of the exit distance over all rays
+                double lo = t_min, hi = t_max;
+                for(int axis = 0; axis < 3; axis++) {
+                    if(!usable[axis])
+                        continue;
+                    double d0 = n.bounds[sign[axis]][axis][k] - orig[axis];
+                    double d1 = n.bounds[1 - sign[axis]][axis][k] - orig[axis];
+                    double t0 = fmin(d0 * inv_lo[axis], d0 * inv_hi[axis]);
+                    double t1 = fmax(d1 * inv_lo[axis], d1 * inv_hi[axis]);
+                    if(t0 > lo) lo = t0;
+                    if(t1 < hi) hi = t1;
+                }
+                t_enter = lo;
+                return lo <= hi * (1 + t_slack) + t_slack;
+            }
+        };
+
+        static bool slot_hit(const node& n, int k, const ray& r, double t_min, double t_max) {
+            const point3& o = r.origin();
+            const vec3& inv = r.inv_direction();
+            double lo = t_min, hi = t_max;
+            for(int axis = 0; axis < 3; axis++) {
+                double t0 = (n.bounds[r.sign(axis)][axis][k] - o[axis]) * inv[axis];
+                double t1 = (n.bounds[1 - r.sign(axis)][axis][k] - o[axis]) * inv[axis];
+                if(t0 > lo) lo = t0;
+                if(t1 < hi) hi = t1;
+            }
+            return lo <= hi;
+        }
+
+        // Relative slack on the float slab distances, covers rounding of the ray to float
+        static constexpr float t_slack = 1e-5f;
+
+        static int box_mask(const node& n, const node* motion, float time, const packed_ray& pr, interval ray_t, float* t_enter) {
+            // 'motion' (or null for still nodes) moves the bounds to 'time'
+            float t_min = float(ray_t.min);
+            float t_max = float(ray_t.max) * (1 + t_slack) + t_slack;
+
+#if defined(__AVX__)
+            if constexpr (N == 8) {
+                __m256 lo = _mm256_set1_ps(t_min);
+                __m256 hi = _mm256_set1_ps(t_max);
+                for(int axis = 0; axis < 3; axis++) {
+                    __m256 o = _mm256_set1_ps(pr.orig[axis]);
+                    __m256 inv = _mm256_set1_ps(pr.inv[axis]);
+                    __m256 near = _mm256_load_ps(n.bounds[pr.sign[axis]][axis]);
+                    __m256 far = _mm256_load_ps(n.bounds[1 - pr.sign[axis]][axis]);
+                    if(motion) {
+                        __m256 s = _mm256_set1_ps(time);
+                        near = _mm256_add_ps(near, _mm256_mul_ps(s, _mm256_load_ps(motion->bounds[pr.sign[axis]][axis])));
+                        far = _mm256_add_ps(far, _mm256_mul_ps(s, _mm256_load_ps(motion->bounds[1 - pr.sign[axis]][axis])));
+                    }
+                    __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(near, o), inv);
+                    __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(far, o), inv);
+                    // NaN in t0/t1 (ray in the slab plane) leaves the interval unchanged
+                    lo = _mm256_max_ps(t0, lo);
+                    hi = _mm256_min_ps(t1, hi);
+                }
+                _mm256_storeu_ps(t_enter, lo);
+                return _mm256_movemask_ps(_mm256_cmp_ps(lo, hi, _CMP_LE_OQ));
+            }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+            if constexpr (N == 4) {
+                __m128 lo = _mm_set1_ps(t_min);
+                __m128 hi = _mm_set1_ps(t_max);
+                for(int axis = 0; axis < 3; axis++) {
+                    __m128 o = _mm_set1_ps(pr.orig[axis]);
+                    __m128 inv = _mm_set1_ps(pr.inv[axis]);
+                    __m128 near = _mm_load_ps(n.bounds[pr.sign[axis]][axis]);
+                    __m128 far = _mm_load_ps(n.bounds[1 - pr.sign[axis]][axis]);
+                    if(motion) {
+                        __m128 s = _mm_set1_ps(time);
+                        near = _mm_add_ps(near, _mm_mul_ps(s, _mm_load_ps(motion->bounds[pr.sign[axis]][axis])));
+                        far = _mm_add_ps(far, _mm_mul_ps(s, _mm_load_ps(motion->bounds[1 - pr.sign[axis]][axis])));
+                    }
+                    __m128 t0 = _mm_mul_ps(_mm_sub_ps(near, o), inv);
+                    __m128 t1 = _mm_mul_ps(_mm_sub_ps(far, o), inv);
+                    lo = _mm_max_ps(t0, lo);
+                    hi = _mm_min_ps(t1, hi);
+                }
+                _mm_storeu_ps(t_enter, lo);
+                return _mm_movemask_ps(_mm_cmple_ps(lo, hi));
+            }
+#endif
+            // Scalar fallback
+            int mask = 0;
+            for(int k = 0; k < N; k++) {
+                float lo = t_min, hi = t_max;
+                for(int axis = 0; axis < 3; axis++) {
+                    float near = n.bounds[pr.sign[axis]][axis][k];
+                    float far = n.bounds[1 - pr.sign[axis]][axis][k];
+                    if(motion) {
+                        near += time * motion->bounds[pr.sign[axis]][axis][k];
+                        far += time * motion->bounds[1 - pr.sign[axis]][axis][k];
+                    }
+                    float t0 = (near - pr.orig[axis]) * pr.inv[axis];
+                    float t1 = (far - pr.orig[axis]) * pr.inv[axis];
+                    if(t0 > lo) lo = t0;
+                    if(t1 < hi) hi = t1;
+                }
+                t_enter[k] = lo;
+                if(lo <= hi)
+                    mask |= 1 << k;
+            }
+            return mask;
+        }
+
+        int collapse(const bvh_node* bvh, int depth) {
+            // Open up the binary subtree below 'bvh' until it has N children, always
+            // expanding the child node with the largest surface area
+            std::vector<const hittable*> children = {bvh->left.get(), bvh->right.get()};
+            while(int(children.size()) < N) {
+                int best = -1;
+                double best_area = -1;
+                for(int k = 0; k < int(children.size()); k++) {
+                    auto child = dynamic_cast<const bvh_node*>(children[k]);
+                    if(child && child->bbox.surface_area() > best_area) {
+                        best = k;
+                        best_area = child->bbox.surface_area();
+                    }
+                }
+                if(best < 0)
+                    break;
+
+                auto child = static_cast<const bvh_node*>(children[best]);
+                children[best] = child->left.get();
+                if(child->right != child->left)
+                    children.push_back(child->right.get());
+            }
+
+            auto index = add_node();
+            for(int k = 0; k < int(children.size()); k++)
+                set_child(index, k, children[k], depth);
+            return index;
+        }
+
+        int add_node() {
+            auto index = int(nodes.size());
+            nodes.push_back(node());
+            clear(nodes[index]);
+            if(moving)
+                motion.push_back(node()); // Zero: empty slots do not move
+            return index;
+        }
+
+        void set_child(int index, int slot, const hittable* object, int depth) {
+            aabb box, close_box;
+            tree->node_bounds(object, box, close_box);
+            for(int axis = 0; axis < 3; axis++) {
+                const interval& ax = box.axis_interval(axis);
+                nodes[index].bounds[0][axis][slot] = round_down(ax.min);
+                nodes[index].bounds[1][axis][slot] = round_up(ax.max);
+                if(moving) {
+                    const interval& cx = close_box.axis_interval(axis);
+                    motion[index].bounds[0][axis][slot] = round_down(cx.min) - nodes[index].bounds[0][axis][slot];
+                    motion[index].bounds[1][axis][slot] = round_up(cx.max) - nodes[index].bounds[1][axis][slot];
+                }
+            }
+
+            // Subtrees deeper than the traversal stack allows stay opaque primitives
+            auto bvh = dynamic_cast<const bvh_node*>(object);
+            if(bvh && bvh->left != bvh->right && depth < max_depth - 1) {
+                int child = collapse(bvh, depth + 1);
+                nodes[index].child[slot] = child;
+            } else if(bvh && bvh->left == bvh->right) {
+                nodes[index].child[slot] = ~int32_t(prims.size());
+                prims.push_back(bvh->left.get());
+            } else {
+                nodes[index].child[slot] = ~int32_t(prims.size());
+                prims.push_back(object);
+            }
+        }
+
+        static void clear(node& n) {
+            for(int axis = 0; axis < 3; axis++) {
+                for(int k = 0; k < N; k++) {
+                    n.bounds[0][axis][k] = std::numeric_limits<float>::infinity();
+                    n.bounds[1][axis][k] = -std::numeric_limits<float>::infinity();
+                }
+            }
+            for(int k = 0; k < N; k++)
+                n.child[k] = 0;
+        }
+
+        static float round_down(double x) {
+            // Outward rounding plus a relative pad for the float ray origin
+            float f = float(x - std::fabs(x) * t_slack);
+            return (double(f) > x) ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+        }
+
+        static float round_up(double x) {
+            float f = float(x + std::fabs(x) * t_slack);
+            return (double(f) < x) ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+        }
+};
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// Heap allocations made by the calling thread. Only counts when the program is built with
+// RT_COUNT_ALLOCATIONS, otherwise it stays 0.
+inline uint64_t& heap_allocations() {
+    thread_local uint64_t count = 0;
+    return count;
+}
+
+#ifdef RT_COUNT_ALLOCATIONS
+// Replacement of the global operator new/delete. Replacements must be defined exactly once
+// per program, which holds as long as the renderer is built as a single translation unit.
+void* operator new(std::size_t size) {
+    heap_allocations()++;
+    if(void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+#endif
+
+#endif
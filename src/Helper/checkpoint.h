@@ -0,0 +1,85 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+// Render Checkpoints
+// A checkpoint holds the finished tiles of a render. Every pixel sample is seeded from
+// (seed, pixel, sample), so the finished tiles plus the settings below are the complete render
+// state: the random sequence of any unfinished tile is reproduced by rendering it from scratch.
+struct checkpoint_settings {
+    // Everything that changes a pixel's value. Only 64-bit fields, so memcmp sees no padding.
+    // The scene itself is not recorded, resuming with a different scene is not detected.
+    int64_t  width = 0, height = 0, tile_size = 0;
+    int64_t  sqrt_spp = 0, max_depth = 0;
+    int64_t  integrator = 0, rr_min_depth = 0, mode = 0;
+    int64_t  adaptive = 0, max_samples_per_pixel = 0;
+    double   adaptive_tolerance = 0, ao_distance = 0;
+    uint64_t seed = 0;
+
+    bool operator==(const checkpoint_settings& o) const {return memcmp(this, &o, sizeof(o)) == 0;}
+};
+
+// File layout: magic, settings, tile count, one byte per tile (1 = finished), then the data
+// of each finished tile in tile order as written by the caller.
+static const char checkpoint_magic[8] = {'R', 'T', 'C', 'K', 'P', 'T', '1', '\n'};
+
+// Writes to path + ".tmp" and renames it over path, so a kill mid-write keeps the previous
+// checkpoint. tile_data(tile, stream) writes the data of one finished tile.
+template <typename F>
+bool write_checkpoint(const std::string& path, const checkpoint_settings& settings,
+                      const std::vector<uint8_t>& done, F&& tile_data) {
+    std::string temp = path + ".tmp";
+    {
+        std::ofstream file(temp, std::ios::binary);
+        uint64_t count = done.size();
+        file.write(checkpoint_magic, sizeof(checkpoint_magic));
+        file.write(reinterpret_cast<const char*>(&settings), sizeof(settings));
+        file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        file.write(reinterpret_cast<const char*>(done.data()), std::streamsize(count));
+        for(size_t i = 0; i < done.size(); i++)
+            if(done[i])
+                tile_data(int(i), file);
+        file.close();
+        if(file.fail())
+            return false;
+    }
+    std::error_code error;
+    std::filesystem::rename(temp, path, error);
+    return !error;
+}
+
+// Reads a checkpoint written with the same settings. tile_data(tile, stream) reads the data of
+// one finished tile, done receives the finished tiles. False if the file is missing, belongs to
+// a different render or is truncated, done is only filled on success.
+template <typename F>
+bool read_checkpoint(const std::string& path, const checkpoint_settings& settings,
+                     std::vector<uint8_t>& done, F&& tile_data) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[sizeof(checkpoint_magic)];
+    checkpoint_settings stored;
+    uint64_t count = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&stored), sizeof(stored));
+    file.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if(!file || memcmp(magic, checkpoint_magic, sizeof(magic)) != 0 || !(stored == settings) || count != done.size())
+        return false;
+
+    std::vector<uint8_t> finished(count);
+    file.read(reinterpret_cast<char*>(finished.data()), std::streamsize(count));
+    for(size_t i = 0; i < finished.size() && file; i++)
+        if(finished[i])
+            tile_data(int(i), file);
+    if(!file)
+        return false;
+    done = finished;
+    return true;
+}
+
+#endif
@@ -14,6 +14,12 @@ inline double linear_to_gamma(double linear_component) {
     return 0;
 }
 
+inline uint8_t to_byte(double linear_component) {
+    // Linear -> Gamma 2, then [0,1] -> [0,255]
+    static const interval intensity(0.000, 0.999);
+    return uint8_t(256 * intensity.clamp(linear_to_gamma(linear_component)));
+}
+
 void write_color(std::ostream& out, const color & pixel_color) {
     auto r = pixel_color.x();
     auto g = pixel_color.y();
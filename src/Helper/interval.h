@@ -3,56 +3,65 @@
 
 #include "rtweekend.h"
 
-class interval {
+template <typename T>
+class interval_t {
     public:
-        double min, max;
+        using scalar = T;
 
-        interval() : min(+infinity), max(-infinity) {} //Default interval empty
+        T min, max;
 
-        interval(double min, double max) : min(min), max(max) {}
+        interval_t() : min(+infinity), max(-infinity) {} //Default interval empty
 
-        interval(const interval&a, const interval& b) {
+        interval_t(T min, T max) : min(min), max(max) {}
+
+        interval_t(const interval_t&a, const interval_t& b) {
             //Tight interval enclosing a,b
             min = a.min <= b.min ? a.min : b.min;
             max = a.max >= b.max ? a.max : b.max;
         }
 
-        double size() const {
+        T size() const {
             return max - min;
         }
 
-        bool contains(double x) const {
+        bool contains(T x) const {
             return min <= x && x <= max;
         }
 
-        bool surrounds(double x) const {
+        bool surrounds(T x) const {
             return min < x && x < max;
         }
 
-        double clamp(double x) const {
+        T clamp(T x) const {
             if (x < min) return min;
             if (x > max) return max;
             return x;
         }
 
-        interval expand(double delta) const {
+        interval_t expand(T delta) const {
             auto padding = delta/2;
-            return interval(min - padding, max + padding);
+            return interval_t(min - padding, max + padding);
         }
 
-        static const interval empty, universe;
+        static const interval_t empty, universe;
 };
 
-const interval interval::empty = interval(+infinity, -infinity);
-const interval interval::universe = interval(-infinity, +infinity);
+template <typename T>
+const interval_t<T> interval_t<T>::empty = interval_t<T>(+infinity, -infinity);
+template <typename T>
+const interval_t<T> interval_t<T>::universe = interval_t<T>(-infinity, +infinity);
+
+using interval = interval_t<real>;
 
-interval operator+(const interval& ival, double displacement) {
-    return interval(ival.min + displacement, ival.max + displacement);
+template <typename T>
+inline interval_t<T> operator+(const interval_t<T>& ival, typename interval_t<T>::scalar displacement) {
+    return interval_t<T>(ival.min + displacement, ival.max + displacement);
 }
 
-interval operator+(double displacement, const interval& ival) {
+template <typename T>
+inline interval_t<T> operator+(typename interval_t<T>::scalar displacement, const interval_t<T>& ival) {
     return ival + displacement;
 }
 
 
-#endif
\ No newline at end of file
+#endif
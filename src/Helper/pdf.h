@@ -29,6 +29,7 @@ class sphere_pdf : public pdf {
 
 class cosine_pdf : public pdf {
     public:
+        cosine_pdf() {}
         cosine_pdf(const vec3& w) {uvw.build_from_w(w);}
 
         double value(const vec3& direction) const override {
@@ -63,9 +64,11 @@ class hittable_pdf : public pdf {
 
 class mixture_pdf : public pdf {
     public:
-        mixture_pdf(shared_ptr<pdf> p0, shared_ptr<pdf> p1) {
-            p[0] = p0;
-            p[1] = p1;
+        // Refers to p0 and p1 without owning them, both are expected to live on the
+        // stack of the bounce that samples the mixture
+        mixture_pdf(const pdf& p0, const pdf& p1) {
+            p[0] = &p0;
+            p[1] = &p1;
         }
 
         double value(const vec3& direction) const override {
@@ -80,7 +83,7 @@ class mixture_pdf : public pdf {
         }
         
     private:
-        shared_ptr<pdf> p[2];
+        const pdf* p[2];
 };
 
 #endif
\ No newline at end of file
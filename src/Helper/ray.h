@@ -3,28 +3,74 @@
 
 #include "vec3.h"
 
-class ray {
+template <typename T>
+class ray_t {
     public:
-        ray() {}
+        using point = vec3_t<T>;
 
-        ray(const point3& origin, const vec3& direction) : orig(origin), dir(direction), tm(0) {}
+        ray_t() {}
 
-        ray(const point3& origin, const vec3& direction, double time)
-         : orig(origin), dir(direction), tm(time) {}
+        ray_t(const point& origin, const vec3_t<T>& direction) : orig(origin), dir(direction), tm(0) {
+            set_inverse();
+        }
+
+        ray_t(const point& origin, const vec3_t<T>& direction, double time)
+         : orig(origin), dir(direction), tm(time) {
+            set_inverse();
+        }
 
-        const point3& origin() const {return orig;}
-        const vec3& direction() const {return dir;}
+        const point& origin() const {return orig;}
+        const vec3_t<T>& direction() const {return dir;}
+
+        // Reciprocal direction and per-axis sign (1 if negative), for slab tests
+        const vec3_t<T>& inv_direction() const {return inv_dir;}
+        int sign(int axis) const {return dir_neg[axis];}
 
         double time() const {return tm;}
 
-        point3 at(double t) const {
+        point at(T t) const {
             return orig + t*dir;
         }
 
     private:
-        point3 orig;
-        vec3 dir;
+        point orig;
+        vec3_t<T> dir;
         double tm;
+        vec3_t<T> inv_dir;
+        int dir_neg[3];
+
+        void set_inverse() {
+            inv_dir = vec3_t<T>(1 / dir.x(), 1 / dir.y(), 1 / dir.z());
+            dir_neg[0] = inv_dir.x() < 0;
+            dir_neg[1] = inv_dir.y() < 0;
+            dir_neg[2] = inv_dir.z() < 0;
+        }
 };
 
-#endif
\ No newline at end of file
+using ray = ray_t<real>;
+
+template <typename T>
+inline vec3_t<T> offset_ray_origin(const vec3_t<T>& p, const vec3_t<T>& n) {
+    // Robust spawn point for secondary rays (Waechter & Binder, Ray Tracing Gems ch. 6):
+    // move p along the normal n (pointing to the side the new ray leaves on) by a fixed
+    // number of ulps of p, or by a small absolute amount close to the origin.
+    // Replaces a fixed t_min, which is either too large or too small depending on scale.
+    using bits = typename std::conditional<sizeof(T) == 4, int32_t, int64_t>::type;
+    const T origin      = T(1.0 / 32.0);
+    const T float_scale = T(1.0 / 65536.0);
+    const T int_scale   = (sizeof(T) == 4) ? T(256) : T(256 * 1024); // double: 2^-34 relative
+
+    vec3_t<T> out;
+    for(int axis = 0; axis < 3; axis++) {
+        bits of_i = bits(int_scale * n[axis]);
+        bits p_i;
+        std::memcpy(&p_i, &p.e[axis], sizeof(T));
+        p_i += (p[axis] < 0) ? -of_i : of_i;
+        T p_f;
+        std::memcpy(&p_f, &p_i, sizeof(T));
+        out[axis] = (fabs(p[axis]) < origin) ? p[axis] + float_scale * n[axis] : p_f;
+    }
+    return out;
+}
+
+#endif
@@ -2,9 +2,12 @@
 #define RTWEEKEND_H
 
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <type_traits>
 
 // Multithreading
 #include <fstream>
@@ -18,6 +21,15 @@ using std::sqrt;
 using std::ofstream;
 using std::thread;
 
+// Geometry Precision
+// vec3, ray, interval and aabb are templates over the scalar type, 'real' picks the one
+// the renderer is built with. Define RT_SINGLE_PRECISION to run the kernel in float.
+#ifdef RT_SINGLE_PRECISION
+using real = float;
+#else
+using real = double;
+#endif
+
 // Constants
 const double infinity = std::numeric_limits<double>::infinity();
 const double pi = 3.1415926535897932385;
@@ -27,9 +39,55 @@ inline double degrees_to_radians(double degrees) {
     return degrees * pi / 180.0;
 }
 
+// Random Number Generation
+// Counter-based engine (SplitMix64): the state is a plain 64-bit counter and every draw
+// hashes the next counter value. Seeding from (pixel, sample) makes each sample's random
+// sequence independent of the thread and tile order it is rendered in.
+class alignas(64) random_engine {
+    public:
+        random_engine(uint64_t seed = 0) : state(seed) {}
+
+        void seed(uint64_t s) {state = s;}
+
+        uint64_t position() const {return state;}
+
+        uint64_t next() {
+            state += 0x9E3779B97F4A7C15ull;
+            return mix(state);
+        }
+
+        double next_double() {
+            // [0,1) with full 53 bit resolution
+            return (next() >> 11) * 0x1.0p-53;
+        }
+
+        static uint64_t mix(uint64_t z) {
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        }
+
+        static uint64_t hash(uint64_t a, uint64_t b) {
+            return mix(mix(a) ^ (b + 0x9E3779B97F4A7C15ull));
+        }
+
+    private:
+        uint64_t state;
+};
+
+inline random_engine& thread_rng() {
+    // One engine per thread, no shared state between worker threads
+    thread_local random_engine engine;
+    return engine;
+}
+
+inline void seed_sample(uint64_t seed, uint64_t pixel, uint64_t sample) {
+    thread_rng().seed(random_engine::hash(random_engine::hash(seed, pixel), sample));
+}
+
 inline double random_double() {
     // [0,1)
-    return rand() / (RAND_MAX + 1.0);
+    return thread_rng().next_double();
 }
 
 inline double random_double(double min, double max) {
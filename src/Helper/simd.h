@@ -0,0 +1,115 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+// N lanes of T with the few operations the SIMD kernels need. Comparisons return a bit mask
+// (bit k set if lane k compares true), so kernels combine them with integer & and |.
+// Specializations use SSE (4 floats, 2x2 doubles) or AVX (8 floats, 4 doubles) when the
+// compiler targets them; everything else takes the plain loops below.
+template <typename T, int N>
+struct simd {
+    T v[N];
+
+    static simd load(const T* p) {simd r; for(int k = 0; k < N; k++) r.v[k] = p[k]; return r;}
+    static simd broadcast(T x)   {simd r; for(int k = 0; k < N; k++) r.v[k] = x; return r;}
+    void store(T* p) const       {for(int k = 0; k < N; k++) p[k] = v[k];}
+
+    friend simd operator+(const simd& a, const simd& b) {simd r; for(int k = 0; k < N; k++) r.v[k] = a.v[k] + b.v[k]; return r;}
+    friend simd operator-(const simd& a, const simd& b) {simd r; for(int k = 0; k < N; k++) r.v[k] = a.v[k] - b.v[k]; return r;}
+    friend simd operator*(const simd& a, const simd& b) {simd r; for(int k = 0; k < N; k++) r.v[k] = a.v[k] * b.v[k]; return r;}
+    friend simd operator/(const simd& a, const simd& b) {simd r; for(int k = 0; k < N; k++) r.v[k] = a.v[k] / b.v[k]; return r;}
+
+    friend int less(const simd& a, const simd& b)    {int m = 0; for(int k = 0; k < N; k++) m |= (a.v[k] < b.v[k]) << k; return m;}
+    friend int greater(const simd& a, const simd& b) {int m = 0; for(int k = 0; k < N; k++) m |= (a.v[k] > b.v[k]) << k; return m;}
+    friend int equal(const simd& a, const simd& b)   {int m = 0; for(int k = 0; k < N; k++) m |= (a.v[k] == b.v[k]) << k; return m;}
+};
+
+#if defined(__SSE2__) || defined(_M_X64)
+template <>
+struct simd<float, 4> {
+    __m128 v;
+
+    static simd load(const float* p) {return {_mm_load_ps(p)};} // 16 byte aligned
+    static simd broadcast(float x)   {return {_mm_set1_ps(x)};}
+    void store(float* p) const       {_mm_storeu_ps(p, v);}
+
+    friend simd operator+(const simd& a, const simd& b) {return {_mm_add_ps(a.v, b.v)};}
+    friend simd operator-(const simd& a, const simd& b) {return {_mm_sub_ps(a.v, b.v)};}
+    friend simd operator*(const simd& a, const simd& b) {return {_mm_mul_ps(a.v, b.v)};}
+    friend simd operator/(const simd& a, const simd& b) {return {_mm_div_ps(a.v, b.v)};}
+
+    friend int less(const simd& a, const simd& b)    {return _mm_movemask_ps(_mm_cmplt_ps(a.v, b.v));}
+    friend int greater(const simd& a, const simd& b) {return _mm_movemask_ps(_mm_cmpgt_ps(a.v, b.v));}
+    friend int equal(const simd& a, const simd& b)   {return _mm_movemask_ps(_mm_cmpeq_ps(a.v, b.v));}
+};
+#endif
+
+#if defined(__AVX__)
+template <>
+struct simd<float, 8> {
+    __m256 v;
+
+    static simd load(const float* p) {return {_mm256_load_ps(p)};} // 32 byte aligned
+    static simd broadcast(float x)   {return {_mm256_set1_ps(x)};}
+    void store(float* p) const       {_mm256_storeu_ps(p, v);}
+
+    friend simd operator+(const simd& a, const simd& b) {return {_mm256_add_ps(a.v, b.v)};}
+    friend simd operator-(const simd& a, const simd& b) {return {_mm256_sub_ps(a.v, b.v)};}
+    friend simd operator*(const simd& a, const simd& b) {return {_mm256_mul_ps(a.v, b.v)};}
+    friend simd operator/(const simd& a, const simd& b) {return {_mm256_div_ps(a.v, b.v)};}
+
+    friend int less(const simd& a, const simd& b)    {return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ));}
+    friend int greater(const simd& a, const simd& b) {return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ));}
+    friend int equal(const simd& a, const simd& b)   {return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ));}
+};
+
+template <>
+struct simd<double, 4> {
+    __m256d v;
+
+    static simd load(const double* p) {return {_mm256_load_pd(p)};} // 32 byte aligned
+    static simd broadcast(double x)   {return {_mm256_set1_pd(x)};}
+    void store(double* p) const       {_mm256_storeu_pd(p, v);}
+
+    friend simd operator+(const simd& a, const simd& b) {return {_mm256_add_pd(a.v, b.v)};}
+    friend simd operator-(const simd& a, const simd& b) {return {_mm256_sub_pd(a.v, b.v)};}
+    friend simd operator*(const simd& a, const simd& b) {return {_mm256_mul_pd(a.v, b.v)};}
+    friend simd operator/(const simd& a, const simd& b) {return {_mm256_div_pd(a.v, b.v)};}
+
+    friend int less(const simd& a, const simd& b)    {return _mm256_movemask_pd(_mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ));}
+    friend int greater(const simd& a, const simd& b) {return _mm256_movemask_pd(_mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ));}
+    friend int equal(const simd& a, const simd& b)   {return _mm256_movemask_pd(_mm256_cmp_pd(a.v, b.v, _CMP_EQ_OQ));}
+};
+#elif defined(__SSE2__) || defined(_M_X64)
+template <>
+struct simd<double, 4> {
+    // Two SSE2 registers of two doubles
+    __m128d lo, hi;
+
+    static simd load(const double* p) {return {_mm_load_pd(p), _mm_load_pd(p + 2)};} // 16 byte aligned
+    static simd broadcast(double x)   {return {_mm_set1_pd(x), _mm_set1_pd(x)};}
+    void store(double* p) const       {_mm_storeu_pd(p, lo); _mm_storeu_pd(p + 2, hi);}
+
+    friend simd operator+(const simd& a, const simd& b) {return {_mm_add_pd(a.lo, b.lo), _mm_add_pd(a.hi, b.hi)};}
+    friend simd operator-(const simd& a, const simd& b) {return {_mm_sub_pd(a.lo, b.lo), _mm_sub_pd(a.hi, b.hi)};}
+    friend simd operator*(const simd& a, const simd& b) {return {_mm_mul_pd(a.lo, b.lo), _mm_mul_pd(a.hi, b.hi)};}
+    friend simd operator/(const simd& a, const simd& b) {return {_mm_div_pd(a.lo, b.lo), _mm_div_pd(a.hi, b.hi)};}
+
+    friend int less(const simd& a, const simd& b) {
+        return _mm_movemask_pd(_mm_cmplt_pd(a.lo, b.lo)) | _mm_movemask_pd(_mm_cmplt_pd(a.hi, b.hi)) << 2;
+    }
+    friend int greater(const simd& a, const simd& b) {
+        return _mm_movemask_pd(_mm_cmpgt_pd(a.lo, b.lo)) | _mm_movemask_pd(_mm_cmpgt_pd(a.hi, b.hi)) << 2;
+    }
+    friend int equal(const simd& a, const simd& b) {
+        return _mm_movemask_pd(_mm_cmpeq_pd(a.lo, b.lo)) | _mm_movemask_pd(_mm_cmpeq_pd(a.hi, b.hi)) << 2;
+    }
+};
+#endif
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "rtweekend.h"
+
+#include "../Bounding_Volume_Hierarchies/aabb.h"
+
+// Affine 4x4 matrix. Only the top three rows are stored, the bottom row is always (0, 0, 0, 1).
+// Kept in double regardless of 'real', products are rounded once when applied to a vec3.
+class transform {
+    public:
+        double m[3][4];
+
+        transform() : m{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}} {}
+
+        static transform translation(const vec3& offset) {
+            transform t;
+            for(int i = 0; i < 3; i++)
+                t.m[i][3] = offset[i];
+            return t;
+        }
+
+        static transform scaling(const vec3& s) {
+            transform t;
+            for(int i = 0; i < 3; i++)
+                t.m[i][i] = s[i];
+            return t;
+        }
+
+        // Counter-clockwise rotations (right-handed) by angle degrees
+        static transform rotation_x(double angle) {return rotation(0, angle);}
+        static transform rotation_y(double angle) {return rotation(1, angle);}
+        static transform rotation_z(double angle) {return rotation(2, angle);}
+
+        // t applied around pivot instead of the origin
+        static transform about(const point3& pivot, const transform& t) {
+            return translation(pivot) * t * translation(-pivot);
+        }
+
+        // a * b applies b first
+        friend transform operator*(const transform& a, const transform& b) {
+            transform r;
+            for(int i = 0; i < 3; i++) {
+                for(int j = 0; j < 4; j++) {
+                    double sum = j == 3 ? a.m[i][3] : 0;
+                    for(int k = 0; k < 3; k++)
+                        sum += a.m[i][k] * b.m[k][j];
+                    r.m[i][j] = sum;
+                }
+            }
+            return r;
+        }
+
+        transform inverse() const {
+            // Inverse of the 3x3 part by cofactors, the translation is moved through it
+            double c[3][3];
+            for(int i = 0; i < 3; i++) {
+                for(int j = 0; j < 3; j++) {
+                    int i1 = (i + 1) % 3, i2 = (i + 2) % 3, j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+                    c[j][i] = m[i1][j1] * m[i2][j2] - m[i1][j2] * m[i2][j1];
+                }
+            }
+            double det = m[0][0] * c[0][0] + m[0][1] * c[1][0] + m[0][2] * c[2][0];
+
+            transform r;
+            for(int i = 0; i < 3; i++) {
+                for(int j = 0; j < 3; j++)
+                    r.m[i][j] = c[i][j] / det;
+            }
+            for(int i = 0; i < 3; i++)
+                r.m[i][3] = -(r.m[i][0] * m[0][3] + r.m[i][1] * m[1][3] + r.m[i][2] * m[2][3]);
+            return r;
+        }
+
+        point3 point(const point3& p) const {
+            return point3(row(0, p) + m[0][3], row(1, p) + m[1][3], row(2, p) + m[2][3]);
+        }
+
+        vec3 vector(const vec3& v) const {
+            return vec3(row(0, v), row(1, v), row(2, v));
+        }
+
+        // Normals are carried by the inverse transpose: call this on the inverse of the transform
+        // that moves the points. The result is not normalized.
+        vec3 normal(const vec3& n) const {
+            return vec3(m[0][0] * n[0] + m[1][0] * n[1] + m[2][0] * n[2],
+                        m[0][1] * n[0] + m[1][1] * n[1] + m[2][1] * n[2],
+                        m[0][2] * n[0] + m[1][2] * n[1] + m[2][2] * n[2]);
+        }
+
+        aabb box(const aabb& b) const {
+            // Bounds of the eight transformed corners
+            point3 min( infinity, infinity, infinity);
+            point3 max(-infinity,-infinity,-infinity);
+            for(int i = 0; i < 8; i++) {
+                point3 corner = point(point3(i & 1 ? b.x.max : b.x.min,
+                                             i & 2 ? b.y.max : b.y.min,
+                                             i & 4 ? b.z.max : b.z.min));
+                for(int c = 0; c < 3; c++) {
+                    min[c] = fmin(min[c], corner[c]);
+                    max[c] = fmax(max[c], corner[c]);
+                }
+            }
+            return aabb(min, max);
+        }
+
+    private:
+        double row(int i, const vec3& v) const {
+            return m[i][0] * v[0] + m[i][1] * v[1] + m[i][2] * v[2];
+        }
+
+        static transform rotation(int axis, double angle) {
+            auto radians = degrees_to_radians(angle);
+            double sin_theta = sin(radians), cos_theta = cos(radians);
+            int a = (axis + 1) % 3, b = (axis + 2) % 3;
+            transform t;
+            t.m[a][a] = cos_theta; t.m[a][b] = -sin_theta;
+            t.m[b][a] = sin_theta; t.m[b][b] = cos_theta;
+            return t;
+        }
+};
+
+#endif
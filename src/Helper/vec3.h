@@ -3,45 +3,52 @@
 
 #include "rtweekend.h"
 
-class vec3 {
+template <typename T>
+class vec3_t {
     public:
-        double e[3];
+        using scalar = T;
 
-        vec3() : e{0,0,0} {}
-        vec3(double e0, double e1, double e2) : e{e0, e1, e2} {}
-        vec3(double* i): e{*i, i[1], i[2]} {}
+        T e[3];
 
-        double x() const {return e[0];}
-        double y() const {return e[1];}
-        double z() const {return e[2];}
+        vec3_t() : e{0,0,0} {}
+        vec3_t(T e0, T e1, T e2) : e{e0, e1, e2} {}
+        vec3_t(const double* i): e{T(*i), T(i[1]), T(i[2])} {}
 
-        vec3 operator-() const {return vec3(-e[0], -e[1], -e[2]);}
-        double operator[](int i) const { return e[i];}
-        double& operator[](int i)  { return e[i];}
+        // Conversion between precisions, e.g. double scene setup into a float kernel
+        template <typename U>
+        explicit vec3_t(const vec3_t<U>& v) : e{T(v.e[0]), T(v.e[1]), T(v.e[2])} {}
 
-        vec3& operator+=(const vec3& v) {
+        T x() const {return e[0];}
+        T y() const {return e[1];}
+        T z() const {return e[2];}
+
+        vec3_t operator-() const {return vec3_t(-e[0], -e[1], -e[2]);}
+        T operator[](int i) const { return e[i];}
+        T& operator[](int i)  { return e[i];}
+
+        vec3_t& operator+=(const vec3_t& v) {
             e[0] += v.e[0];
             e[1] += v.e[1];
             e[2] += v.e[2];
             return *this;
         }
 
-        vec3& operator*=(double t) {
+        vec3_t& operator*=(T t) {
             e[0] *= t;
             e[1] *= t;
             e[2] *= t;
             return *this;
         }
 
-        vec3& operator/=(double t) {
+        vec3_t& operator/=(T t) {
             return *this *= 1/t;
         }
 
-        double length() const {
+        T length() const {
             return sqrt(length_squared());
         }
 
-        double length_squared() const {
+        T length_squared() const {
             return e[0]*e[0] + e[1]*e[1] + e[2]*e[2];
         }
 
@@ -50,61 +57,75 @@ class vec3 {
             return (fabs(e[0])<s) && (fabs(e[1])<s) && (fabs(e[2])<s);
         }
 
-        static vec3 random() {
-            return vec3(random_double(), random_double(), random_double());
+        static vec3_t random() {
+            return vec3_t(random_double(), random_double(), random_double());
         }
 
-        static vec3 random(double min, double max) {
-            return vec3(random_double(min, max), random_double(min, max), random_double(min, max));
+        static vec3_t random(double min, double max) {
+            return vec3_t(random_double(min, max), random_double(min, max), random_double(min, max));
         }
 
 };
 
+// Kernel precision, see 'real' in rtweekend.h
+using vec3 = vec3_t<real>;
+
 // point3 as alias
 using point3 = vec3;
 
 // Vector Utility Functions
+// Scalars are taken as vec3_t<T>::scalar so that e.g. 'double * vec3_t<float>' still converts
 
-inline std::ostream& operator<<(std::ostream& out, const vec3& v) {
+template <typename T>
+inline std::ostream& operator<<(std::ostream& out, const vec3_t<T>& v) {
     return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
 }
 
-inline vec3 operator+(const vec3& u, const vec3& v) {
-    return vec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
+template <typename T>
+inline vec3_t<T> operator+(const vec3_t<T>& u, const vec3_t<T>& v) {
+    return vec3_t<T>(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
 }
 
-inline vec3 operator-(const vec3& u, const vec3& v) {
-    return vec3(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
+template <typename T>
+inline vec3_t<T> operator-(const vec3_t<T>& u, const vec3_t<T>& v) {
+    return vec3_t<T>(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
 }
 // Vec x Vec
-inline vec3 operator*(const vec3& u, const vec3& v) {
-    return vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
+template <typename T>
+inline vec3_t<T> operator*(const vec3_t<T>& u, const vec3_t<T>& v) {
+    return vec3_t<T>(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
 }
 // Vec x Const
-inline vec3 operator*(const vec3& u, double t) {
-    return vec3(t* u.e[0], t* u.e[1], t* u.e[2]);
+template <typename T>
+inline vec3_t<T> operator*(const vec3_t<T>& u, typename vec3_t<T>::scalar t) {
+    return vec3_t<T>(t* u.e[0], t* u.e[1], t* u.e[2]);
 }
-inline vec3 operator*(double t, const vec3& v) {
-    return vec3(t* v.e[0], t* v.e[1], t* v.e[2]);
+template <typename T>
+inline vec3_t<T> operator*(typename vec3_t<T>::scalar t, const vec3_t<T>& v) {
+    return vec3_t<T>(t* v.e[0], t* v.e[1], t* v.e[2]);
 }
 
-inline vec3 operator/(const vec3& v, double t) {
+template <typename T>
+inline vec3_t<T> operator/(const vec3_t<T>& v, typename vec3_t<T>::scalar t) {
     return (1/t)*v;
 }
 
-inline double dot(const vec3& u, const vec3& v) {
+template <typename T>
+inline T dot(const vec3_t<T>& u, const vec3_t<T>& v) {
     return u.e[0] * v.e[0]
          + u.e[1] * v.e[1]
          + u.e[2] * v.e[2];
 }
 
-inline vec3 cross(const vec3& u, const vec3& v) {
-    return vec3(u.e[1] * v.e[2] - u.e[2] * v.e[1],
-                u.e[2] * v.e[0] - u.e[0] * v.e[2],
-                u.e[0] * v.e[1] - u.e[1] * v.e[0]);
+template <typename T>
+inline vec3_t<T> cross(const vec3_t<T>& u, const vec3_t<T>& v) {
+    return vec3_t<T>(u.e[1] * v.e[2] - u.e[2] * v.e[1],
+                     u.e[2] * v.e[0] - u.e[0] * v.e[2],
+                     u.e[0] * v.e[1] - u.e[1] * v.e[0]);
 }
 
-inline vec3 unit_vector(const vec3& v) {
+template <typename T>
+inline vec3_t<T> unit_vector(const vec3_t<T>& v) {
     return v/v.length();
 }
 
@@ -149,15 +170,17 @@ inline vec3 random_cosine_direction() {
     return vec3(x, y, z);
 }
 
-inline vec3 reflect(const vec3& v, const vec3& n) {
+template <typename T>
+inline vec3_t<T> reflect(const vec3_t<T>& v, const vec3_t<T>& n) {
     return v - 2*dot(v,n)*n;
 }
 
-inline vec3 refract(const vec3& uv, const vec3& n, double etai_over_etat) {
-    auto cos_theta = fmin(dot(-uv, n), 1.0);
-    vec3 r_out_perp = etai_over_etat * (uv + cos_theta*n);
-    vec3 r_out_parallel = -sqrt(fabs(1.0 - r_out_perp.length_squared())) * n;
+template <typename T>
+inline vec3_t<T> refract(const vec3_t<T>& uv, const vec3_t<T>& n, typename vec3_t<T>::scalar etai_over_etat) {
+    auto cos_theta = fmin(dot(-uv, n), T(1));
+    vec3_t<T> r_out_perp = etai_over_etat * (uv + cos_theta*n);
+    vec3_t<T> r_out_parallel = -sqrt(fabs(1 - r_out_perp.length_squared())) * n;
     return r_out_perp + r_out_parallel;
 }
 
-#endif
\ No newline at end of file
+#endif
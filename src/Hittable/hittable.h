@@ -4,18 +4,29 @@
 #include "../Helper/rtweekend.h"
 
 #include "../Bounding_Volume_Hierarchies/aabb.h"
+#include "../Helper/transform.h"
 
 class material;
+class hittable;
 
 class hit_record {
     public:
         point3 p; // Hit-Point
         vec3 normal;
-        shared_ptr<material> mat;
-        double t; // Closest Hit-Distance
+        const material* mat = nullptr; // Owned by the object that was hit, no refcount per hit
+        real t; // Closest Hit-Distance
         double u, v;
         bool front_face;
 
+        // Hits are recorded in two steps: during traversal a primitive only stores t, 'object' and
+        // whatever it needs to finish the record later (u, v and 'index'). finalize() fills in p,
+        // normal, uv and mat once the closest hit is known. 'object' is null for complete records.
+        const hittable* object = nullptr;
+        uint32_t index = 0; // Primitive-local, e.g. pack and lane of a mesh triangle
+        const hittable* inner = nullptr; // Primitive hit through the instance in 'object'
+
+        inline void finalize(const ray& r);
+
         void set_face_normal(const ray& r, const vec3& outward_normal) {
             // Set hit record normal Vector
             // Pre-Condition: 'outward_normal' is normalized
@@ -26,15 +37,72 @@ class hit_record {
 
 };
 
+// Bundle of coherent rays (e.g. primary rays of neighbouring pixels) traced together.
+// Each ray keeps its own closest hit and the position of its random sequence.
+class ray_packet {
+    public:
+        static const int max_size = 64;
+
+        int        size = 0;
+        ray        rays[max_size];
+        bool       active[max_size];  // Rays taking part in the current hit_packet call
+        bool       found[max_size];   // A hit was recorded in rec
+        real       t_max[max_size];   // Closest hit so far, upper end of each ray's interval
+        uint64_t   rng[max_size];     // thread_rng() position of each ray
+        hit_record rec[max_size];
+
+        void add(const ray& r, uint64_t rng_position) {
+            rays[size] = r;
+            active[size] = true;
+            found[size] = false;
+            t_max[size] = infinity;
+            rng[size] = rng_position;
+            size++;
+        }
+};
+
 class hittable {
     public:
         virtual ~hittable() = default;
         
         virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const = 0;
 
+        // Any hit in ray_t, for shadow and visibility rays: may stop at the first blocker and
+        // skips the hit record. Fallback: a full hit test.
+        virtual bool occluded(const ray& r, interval ray_t) const {
+            hit_record rec;
+            return hit(r, ray_t, rec);
+        }
+
+        // Second step of a hit: completes 'rec', which this object's hit() left with only t and
+        // its own local values. 'r' is the ray hit() was called with.
+        virtual void finalize(const ray& r, hit_record& rec) const {}
+
+        virtual void hit_packet(ray_packet& packet, double t_min) const {
+            // Fallback: one hit per active ray, each on its own random sequence
+            auto& rng = thread_rng();
+            for(int i = 0; i < packet.size; i++) {
+                if(!packet.active[i])
+                    continue;
+                rng.seed(packet.rng[i]);
+                if(hit(packet.rays[i], interval(t_min, packet.t_max[i]), packet.rec[i])) {
+                    packet.found[i] = true;
+                    packet.t_max[i] = packet.rec[i].t;
+                }
+                packet.rng[i] = rng.position();
+            }
+        }
+
         virtual aabb bounding_box() const = 0;
 
-        virtual point3 center(double time) {return point3();} //Needed For Rotation and Scaling, default returns (0, 0, 0)
+        // Bounds at ray times t0 and t1 (0 = shutter open, 1 = close). For times in between the
+        // object stays inside the linear interpolation of the two boxes. False if it does not move.
+        virtual bool motion_bounds(double t0, double t1, aabb& open, aabb& close) const {
+            open = close = bounding_box();
+            return false;
+        }
+
+        virtual point3 center(double time) {return point3();} // Pivot of rotate_* and scale, default returns (0, 0, 0)
 
         virtual double pdf_value(const point3& origin, const vec3& direction) const {
             return 0.0;
@@ -43,373 +111,132 @@ class hittable {
         virtual vec3 random(const point3& origin) const {
             return vec3(1, 0, 0);
         }
-};
 
-class translate : public hittable {
-    public:
-        translate(shared_ptr<hittable> object, const vec3& offset)
-         : object(object), offset(offset) {
-            bbox = object->bounding_box() + offset;
+        // Surface normals lie within 'spread' radians of 'axis', used by light_sampler to skip
+        // lights that face away. Default: any direction.
+        virtual void emission_cone(vec3& axis, double& spread) const {
+            axis = vec3(0, 0, 1);
+            spread = pi;
         }
-        
-        bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-            // Move ray backwards by offset
-            ray offset_r(r.origin() - offset, r.direction(), r.time());
-
-            //Determine if intersection exists
-            if(!object->hit(offset_r, ray_t, rec))
-                return false;
-
-            //Move intersection point forward by the offset
-            rec.p += offset;
-
-            return true;
-        }
-
-        aabb bounding_box() const override {return bbox;}
-
-        point3 center(double time) override {return object->center(time);}
-
-    private:
-        shared_ptr<hittable> object;
-        vec3 offset;
-        aabb bbox;
 };
 
-class rotate_y : public hittable {
+inline void hit_record::finalize(const ray& r) {
+    if(object) {
+        auto primitive = object;
+        object = nullptr;
+        primitive->finalize(r, *this);
+    }
+}
+
+// Object placed in the world by an affine transform. The object (a primitive, a mesh or a BVH
+// over many primitives) is built once in its own space and may be shared by any number of
+// instances, each of which only stores its two matrices and its world bounds. Rays are moved
+// into object space, so t is the same in both spaces.
+class instance : public hittable {
     public:
-        rotate_y(shared_ptr<hittable> object, double angle) : object(object) {
-            auto radians = degrees_to_radians(angle);
-            sin_theta = sin(radians);
-            cos_theta = cos(radians);
-            bbox = object->bounding_box();
-
-            point3 min( infinity, infinity, infinity);
-            point3 max(-infinity,-infinity,-infinity);
-
-            for(int i = 0; i < 2; i++) {
-                for(int j = 0; j < 2; j++) {
-                    for(int k = 0; k < 2; k++) {
-                        auto x = i*bbox.x.max + (1-i)*bbox.x.min;
-                        auto y = j*bbox.y.max + (1-j)*bbox.y.min;
-                        auto z = k*bbox.z.max + (1-k)*bbox.z.min;
-
-                        auto newx =  cos_theta*x + sin_theta*z;
-                        auto newz = -sin_theta*x + cos_theta*z;
-
-                        vec3 tester(newx, y, newz);
-
-                        for(int c = 0; c < 3; c++) {
-                            min[c] = fmin(min[c], tester[c]);
-                            max[c] = fmax(max[c], tester[c]);
-                        }
-                    }
-                }
+        instance(shared_ptr<hittable> object, const transform& to_world) : object(object), to_world(to_world) {
+            // Chains of instances collapse into a single node over the innermost object
+            if(auto inner = std::dynamic_pointer_cast<instance>(object)) {
+                this->object = inner->object;
+                this->to_world = to_world * inner->to_world;
             }
-            bbox = aabb(min, max);
+            to_object = this->to_world.inverse();
+            bbox = this->to_world.box(this->object->bounding_box());
         }
 
         bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-            // Change Ray from world space to object space
-            //auto origin = r.origin(); // Tutorial
-            auto origin = r.origin() - object->center(r.time()); // Fixed
-            auto direction = r.direction();
-            point3 Cpy = origin;
-
-            origin[0] = cos_theta*Cpy[0] - sin_theta*Cpy[2];
-            origin[2] = sin_theta*Cpy[0] + cos_theta*Cpy[2];
-
-            origin += object->center(r.time()); // Fixed
-
-            direction[0] = cos_theta*r.direction()[0] - sin_theta*r.direction()[2];
-            direction[2] = sin_theta*r.direction()[0] + cos_theta*r.direction()[2];
-
-            ray rotated_r(origin, direction, r.time());
-
-            // Determine if Intersection in object space
-            if(!object->hit(rotated_r, ray_t, rec))
+            // The record keeps the primitive in 'inner' and this instance in 'object', so only the
+            // closest hit is moved to world space. 'inner' is cleared first: set after the hit, it
+            // comes from another instance inside 'object', whose hit is then completed right away.
+            ray object_r = to_object_ray(r);
+            auto previous = rec.inner;
+            rec.inner = nullptr;
+            if(!object->hit(object_r, ray_t, rec)) {
+                rec.inner = previous;
                 return false;
-            
-            // Change intersection point from object space to world space
-            //auto p = rec.p; // Tutorial
-            auto p = rec.p - object->center(r.time()); // Fixed
-            Cpy = p;
-
-            p[0] = cos_theta*Cpy[0] + sin_theta*Cpy[2];
-            p[2] = -sin_theta*Cpy[0] + cos_theta*Cpy[2];
-
-            p += object->center(r.time()); // Fixed
-
-            // Change Normal from object space to world space
-            auto normal = rec.normal;
-            normal[0] = cos_theta*rec.normal[0] + sin_theta*rec.normal[2];
-            normal[2] = -sin_theta*rec.normal[0] + cos_theta*rec.normal[2];
-
-            rec.p = p;
-            rec.normal = normal;
+            }
 
+            if(rec.inner) {
+                rec.finalize(object_r);
+                to_world_record(rec);
+                return true;
+            }
+            rec.inner = rec.object;
+            rec.object = this;
             return true;
         }
 
-        aabb bounding_box() const override {return bbox;}
-
-        point3 center(double time) override {return object->center(time);}
-
-    private:
-        shared_ptr<hittable> object;
-        double sin_theta;
-        double cos_theta;
-        aabb bbox;
-};
-
-class rotate_x : public hittable {
-    public:
-        rotate_x(shared_ptr<hittable> object, double angle) : object(object) {
-            auto radians = degrees_to_radians(angle);
-            sin_theta = sin(radians);
-            cos_theta = cos(radians);
-            bbox = object->bounding_box();
-
-            point3 min( infinity, infinity, infinity);
-            point3 max(-infinity,-infinity,-infinity);
-
-            for(int i = 0; i < 2; i++) {
-                for(int j = 0; j < 2; j++) {
-                    for(int k = 0; k < 2; k++) {
-                        auto x = i*bbox.x.max + (1-i)*bbox.x.min;
-                        auto y = j*bbox.y.max + (1-j)*bbox.y.min;
-                        auto z = k*bbox.z.max + (1-k)*bbox.z.min;
-
-                        auto newy = cos_theta*y - sin_theta*z;
-                        auto newz = sin_theta*y + cos_theta*z;
-
-                        vec3 tester(x, newy, newz);
-
-                        for(int c = 0; c < 3; c++) {
-                            min[c] = fmin(min[c], tester[c]);
-                            max[c] = fmax(max[c], tester[c]);
-                        }
-                    }
-                }
-            }
-            bbox = aabb(min, max);
+        void finalize(const ray& r, hit_record& rec) const override {
+            // Finished in object space, where the primitive computes its normal
+            rec.object = rec.inner;
+            rec.finalize(to_object_ray(r));
+            to_world_record(rec);
         }
 
-        bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-            // Change Ray from world space to object space
-            auto origin = r.origin() - object->center(r.time());;
-            auto direction = r.direction();
-            point3 Cpy = origin;
-
-            origin[2] = cos_theta*Cpy[2] - sin_theta*Cpy[1];
-            origin[1] = sin_theta*Cpy[2] + cos_theta*Cpy[1];
-
-            origin += object->center(r.time());
-
-            direction[2] = cos_theta*r.direction()[2] - sin_theta*r.direction()[1];
-            direction[1] = sin_theta*r.direction()[2] + cos_theta*r.direction()[1];
-
-            ray rotated_r(origin, direction, r.time());
-
-            // Determine if Intersection in object space
-            if(!object->hit(rotated_r, ray_t, rec))
-                return false;
-            
-            // Change intersection point from object space to world space
-            auto p = rec.p - object->center(r.time());
-            Cpy = p;
-
-            p[2] = cos_theta*Cpy[2] + sin_theta*Cpy[1];
-            p[1] = -sin_theta*Cpy[2] + cos_theta*Cpy[1];
-
-            p += object->center(r.time());
-
-            // Change Normal from object space to world space
-            auto normal = rec.normal;
-
-            normal[2] = cos_theta*rec.normal[2] + sin_theta*rec.normal[1];
-            normal[1] = -sin_theta*rec.normal[2] + cos_theta*rec.normal[1];
+        bool occluded(const ray& r, interval ray_t) const override {
+            return object->occluded(to_object_ray(r), ray_t);
+        }
 
-            rec.p = p;
-            rec.normal = normal;
+        aabb bounding_box() const override {return bbox;}
 
-            return true;
+        bool motion_bounds(double t0, double t1, aabb& open, aabb& close) const override {
+            // The corner boxes of an interpolated box lie on the interpolation of the corner boxes
+            bool moving = object->motion_bounds(t0, t1, open, close);
+            open = to_world.box(open);
+            close = to_world.box(close);
+            return moving;
         }
 
-        aabb bounding_box() const override {return bbox;}
+        point3 center(double time) override {return to_world.point(object->center(time));}
 
-        point3 center(double time) override {return object->center(time);}
+        const transform& object_to_world() const {return to_world;}
 
     private:
         shared_ptr<hittable> object;
-        double sin_theta;
-        double cos_theta;
+        transform to_world;
+        transform to_object;
         aabb bbox;
-};
 
-class rotate_z : public hittable {
-    public:
-        rotate_z(shared_ptr<hittable> object, double angle) : object(object) {
-            auto radians = degrees_to_radians(angle);
-            sin_theta = sin(radians);
-            cos_theta = cos(radians);
-            bbox = object->bounding_box();
-
-            point3 min( infinity, infinity, infinity);
-            point3 max(-infinity,-infinity,-infinity);
-
-            for(int i = 0; i < 2; i++) {
-                for(int j = 0; j < 2; j++) {
-                    for(int k = 0; k < 2; k++) {
-                        auto x = i*bbox.x.max + (1-i)*bbox.x.min;
-                        auto y = j*bbox.y.max + (1-j)*bbox.y.min;
-                        auto z = k*bbox.z.max + (1-k)*bbox.z.min;
-
-                        auto newx = cos_theta*x - sin_theta*y;
-                        auto newy = sin_theta*x + cos_theta*y;
-
-                        vec3 tester(newx, newy, z);
-
-                        for(int c = 0; c < 3; c++) {
-                            min[c] = fmin(min[c], tester[c]);
-                            max[c] = fmax(max[c], tester[c]);
-                        }
-                    }
-                }
-            }
-            bbox = aabb(min, max);
+        ray to_object_ray(const ray& r) const {
+            return ray(to_object.point(r.origin()), to_object.vector(r.direction()), r.time());
         }
 
-        bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-            // Change Ray from world space to object space
-            auto origin = r.origin() - object->center(r.time());
-            auto direction = r.direction();
-            point3 Cpy = origin;
-
-            origin[1] = cos_theta*Cpy[1] - sin_theta*Cpy[0];
-            origin[0] = sin_theta*Cpy[1] + cos_theta*Cpy[0];
-
-            origin += object->center(r.time());
-
-            direction[1] = cos_theta*r.direction()[1] - sin_theta*r.direction()[0];
-            direction[0] = sin_theta*r.direction()[1] + cos_theta*r.direction()[0];
-
-            ray rotated_r(origin, direction, r.time());
-
-            // Determine if Intersection in object space
-            if(!object->hit(rotated_r, ray_t, rec))
-                return false;
-            
-            // Change intersection point from object space to world space
-            auto p = rec.p - object->center(r.time());
-            Cpy = p;
-
-            p[1] = cos_theta*Cpy[1] + sin_theta*Cpy[0];
-            p[0] = -sin_theta*Cpy[1] + cos_theta*Cpy[0];
-
-            p += object->center(r.time());
-
-            // Change Normal from object space to world space
-            auto normal = rec.normal;
-            normal[1] = cos_theta*rec.normal[1] + sin_theta*rec.normal[0];
-            normal[0] = -sin_theta*rec.normal[1] + cos_theta*rec.normal[0];
-
-            rec.p = p;
-            rec.normal = normal;
-
-            return true;
+        void to_world_record(hit_record& rec) const {
+            rec.p = to_world.point(rec.p);
+            rec.normal = unit_vector(to_object.normal(rec.normal));
         }
+};
 
-        aabb bounding_box() const override {return bbox;}
+// Single transforms as instances. Rotation and scaling act around the object's center at
+// time 0, as object->center() defines it.
+class translate : public instance {
+    public:
+        translate(shared_ptr<hittable> object, const vec3& offset)
+         : instance(object, transform::translation(offset)) {}
+};
 
-        point3 center(double time) override {return object->center(time);}
+class rotate_x : public instance {
+    public:
+        rotate_x(shared_ptr<hittable> object, double angle)
+         : instance(object, transform::about(object->center(0), transform::rotation_x(angle))) {}
+};
 
-    private:
-        shared_ptr<hittable> object;
-        double sin_theta;
-        double cos_theta;
-        aabb bbox;
+class rotate_y : public instance {
+    public:
+        rotate_y(shared_ptr<hittable> object, double angle)
+         : instance(object, transform::about(object->center(0), transform::rotation_y(angle))) {}
 };
 
-// TODO: Scaling
+class rotate_z : public instance {
+    public:
+        rotate_z(shared_ptr<hittable> object, double angle)
+         : instance(object, transform::about(object->center(0), transform::rotation_z(angle))) {}
+};
 
-class scale : public hittable {
+class scale : public instance {
     public:
         scale(shared_ptr<hittable> object, const vec3& scaling)
-        : object(object), scaleVec(scaling){
-            //Scale the bbox from the center point outward
-            xScaled = object->bounding_box().x;
-            yScaled = object->bounding_box().y;
-            zScaled = object->bounding_box().z;
-
-            int mid = xScaled.max/2 + xScaled.min/2;
-            int lower = mid - scaleVec.x()*xScaled.min;
-            int upper = mid + scaleVec.x()*xScaled.max;
-            xScaled = interval(lower, upper);
-
-            mid = yScaled.max/2 + yScaled.min/2;
-            lower = mid - scaleVec.y()*yScaled.min;
-            upper = mid + scaleVec.y()*yScaled.max;
-            yScaled = interval(lower, upper);
-
-            mid = zScaled.max/2 + zScaled.min/2;
-            lower = mid - scaleVec.z()*zScaled.min;
-            upper = mid + scaleVec.z()*zScaled.max;
-            zScaled = interval(lower, upper);
-
-            bbox = aabb(xScaled, yScaled, zScaled);
-        }
-
-        bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-            // BUG: Doesn't work with intersecting objects
-            //Scale object
-            vec3 invScale(1.0 / scaleVec.x(), 1.0 / scaleVec.y(), 1.0 / scaleVec.z());
-            
-            // Move Obj Center to (0, 0, 0)
-            auto origin = r.origin() - object->center(r.time());
-            auto direction = r.direction();
-
-            // Inverse Scale Camera
-            origin = origin * invScale;
-
-            // Move Obj Center back$
-            origin += object->center(r.time());
-
-            ray scaled_r(origin, direction, r.time());
-
-            // Determine if Intersection in object space
-            if(!object->hit(scaled_r, ray_t, rec))
-                return false;
-
-            // Change intersection point from object space to world space
-            auto p = rec.p - object->center(r.time());
-
-            p = p * scaleVec;
-
-            p += object->center(r.time());
-
-            // Change Normal from object space to world space
-            auto normal = rec.normal;
-            // Normal should be consistent with recorded Ray
-            /*
-            normal[1] = cos_theta*rec.normal[1] + sin_theta*rec.normal[0];
-            normal[0] = -sin_theta*rec.normal[1] + cos_theta*rec.normal[0];
-            */
-
-            rec.p = p;
-            rec.normal = normal;
-
-            return true;
-        }
-
-        aabb bounding_box() const override {return bbox;}
-    private:
-        shared_ptr<hittable> object;
-        vec3 scaleVec;
-        aabb bbox;
-        interval xScaled;
-        interval yScaled;
-        interval zScaled;
+         : instance(object, transform::about(object->center(0), transform::scaling(scaling))) {}
 };
 
 #endif
\ No newline at end of file
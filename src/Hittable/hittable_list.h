@@ -17,32 +17,61 @@ class hittable_list : public hittable {
 
         void clear() {
             objects.clear();
+            bbox = aabb();
+            moving = false;
             cUpdate = false;
         }
         void add(shared_ptr<hittable> object) {
             objects.push_back(object);
             bbox = aabb(bbox, object->bounding_box());
+            aabb open, close;
+            moving = object->motion_bounds(0, 1, open, close) || moving;
             cUpdate = false;
         }
 
         bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-            hit_record temp_rec;
+            // Objects leave rec alone on a miss, so each closer hit simply overwrites it
             bool hit_anything = false;
             auto closest_so_far = ray_t.max;
 
             for(const auto& object : objects) {
-                if(object->hit(r,interval(ray_t.min, closest_so_far), temp_rec)) {
+                if(object->hit(r,interval(ray_t.min, closest_so_far), rec)) {
                     hit_anything = true;
-                    closest_so_far = temp_rec.t;
-                    rec = temp_rec;
+                    closest_so_far = rec.t;
                 }
             }
 
             return hit_anything;
         }
 
+        bool occluded(const ray& r, interval ray_t) const override {
+            for(const auto& object : objects) {
+                if(object->occluded(r, ray_t))
+                    return true;
+            }
+            return false;
+        }
+
+        void hit_packet(ray_packet& packet, double t_min) const override {
+            for(const auto& object : objects)
+                object->hit_packet(packet, t_min);
+        }
+
         aabb bounding_box() const override {return bbox;}
 
+        bool motion_bounds(double t0, double t1, aabb& open, aabb& close) const override {
+            if(!moving)
+                return hittable::motion_bounds(t0, t1, open, close);
+            open = close = aabb::empty;
+            for(const auto& object : objects) {
+                aabb object_open, object_close;
+                object->motion_bounds(t0, t1, object_open, object_close);
+                open = aabb(open, object_open);
+                close = aabb(close, object_close);
+            }
+            return true;
+        }
+
         double pdf_value(const point3& origin, const vec3& direction) const override {
             if(objects.empty())
                 return random_double();
@@ -86,6 +115,7 @@ class hittable_list : public hittable {
 
     private:
         aabb bbox;
+        bool moving = false; // Some object moves during the shutter interval
         point3 cPoint;
         bool cUpdate = false;
 };
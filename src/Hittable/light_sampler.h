@@ -0,0 +1,238 @@
+#ifndef LIGHT_SAMPLER_H
+#define LIGHT_SAMPLER_H
+
+#include "../Helper/rtweekend.h"
+
+#include "../Bounding_Volume_Hierarchies/aabb.h"
+#include "hittable.h"
+#include "hittable_list.h"
+
+#include <algorithm>
+#include <vector>
+
+// Light list for many lights: a binary tree over the lights in which every node knows the
+// power, the bounds and the cone of emission directions of the lights below it.
+// random() walks down from the root and picks a child with probability proportional to its
+// estimated contribution at the shading point (power over distance squared, zero if the point
+// lies outside the cone), so bright, near lights facing the point are picked most often.
+// pdf_value() only descends into nodes whose box the direction hits, multiplying up the same
+// child probabilities. Both cost O(log n) for n lights instead of O(n).
+class light_sampler : public hittable {
+    public:
+        // 'powers' weights the lights (e.g. emitted radiance times area); without them all lights
+        // count as equally bright and only distance and orientation decide
+        light_sampler(const hittable_list& list, const std::vector<double>& powers = {})
+         : lights(list.objects) {
+            std::vector<node> leaves;
+            std::vector<int> order(lights.size());
+            for(size_t i = 0; i < lights.size(); i++) {
+                order[i] = int(i);
+                node leaf;
+                double spread;
+                lights[i]->emission_cone(leaf.axis, spread);
+                leaf.cos_o = cos(spread);
+                leaf.sin_o = sin(spread);
+                leaf.power = i < powers.size() ? powers[i] : 1.0;
+                leaf.light = int(i);
+                set_box(leaf, lights[i]->bounding_box());
+                leaves.push_back(leaf);
+            }
+
+            if(!lights.empty())
+                build(leaves, order, 0, order.size());
+
+            bbox = nodes.empty() ? aabb::empty : nodes[0].box;
+        }
+
+        bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+            return !nodes.empty() && node_hit(0, r, ray_t, rec);
+        }
+
+        aabb bounding_box() const override {return bbox;}
+
+        double pdf_value(const point3& origin, const vec3& direction) const override {
+            if(nodes.empty())
+                return 0.0;
+            return node_pdf(0, ray(origin, direction), 1.0);
+        }
+
+        vec3 random(const point3& origin) const override {
+            if(nodes.empty())
+                return random_unit_vector();
+
+            int index = 0;
+            while(nodes[index].light < 0) {
+                const node& n = nodes[index];
+                index = random_double() < left_probability(n, origin) ? n.left : n.right;
+            }
+            return lights[nodes[index].light]->random(origin);
+        }
+
+    private:
+        struct node {
+            aabb   box;
+            point3 center;
+            double radius_squared;       // Of the sphere around box
+            vec3   axis = vec3(0, 0, 1); // Surface normals lie within angle theta_o of axis
+            double cos_o = -1, sin_o = 0;
+            double power = 0;
+            int    left = -1, right = -1;
+            int    light = -1;           // Leaf: index into lights
+        };
+
+        std::vector<shared_ptr<hittable>> lights;
+        std::vector<node> nodes; // Depth-first, root first
+        aabb bbox;
+
+        int build(const std::vector<node>& leaves, std::vector<int>& order, size_t start, size_t end) {
+            auto index = int(nodes.size());
+            nodes.push_back(node());
+
+            if(end - start == 1) {
+                nodes[index] = leaves[order[start]];
+                return index;
+            }
+
+            // Median split of the light centers along the axis they spread most in
+            aabb centers = aabb::empty;
+            for(size_t i = start; i < end; i++) {
+                auto c = centroid(leaves[order[i]].box);
+                centers = aabb(centers, aabb(c, c));
+            }
+            int axis = centers.longest_axis();
+            size_t mid = start + (end - start) / 2;
+            std::nth_element(order.begin() + start, order.begin() + mid, order.begin() + end,
+                [&](int a, int b) {
+                    return centroid(leaves[a].box)[axis] < centroid(leaves[b].box)[axis];
+                });
+
+            int left = build(leaves, order, start, mid);
+            int right = build(leaves, order, mid, end);
+
+            node& n = nodes[index];
+            const node& l = nodes[left];
+            const node& r = nodes[right];
+            n.left = left;
+            n.right = right;
+            set_box(n, aabb(l.box, r.box));
+            n.power = l.power + r.power;
+            merge_cones(l, r, n);
+            return index;
+        }
+
+        static void set_box(node& n, const aabb& box) {
+            n.box = box;
+            n.center = centroid(box);
+            n.radius_squared = (vec3(box.x.size(), box.y.size(), box.z.size()) / 2).length_squared();
+        }
+
+        static void merge_cones(const node& a, const node& b, node& n) {
+            // Smallest cone around both normal cones; the wider one goes first
+            const node& wide = a.cos_o <= b.cos_o ? a : b;
+            const node& narrow = a.cos_o <= b.cos_o ? b : a;
+            auto theta_w = acos(fmin(1.0, fmax(-1.0, wide.cos_o)));
+            auto theta_n = acos(fmin(1.0, fmax(-1.0, narrow.cos_o)));
+            auto theta_d = acos(fmin(1.0, fmax(-1.0, dot(wide.axis, narrow.axis))));
+            n.axis = wide.axis;
+            n.cos_o = wide.cos_o;
+            n.sin_o = wide.sin_o;
+            if(fmin(theta_d + theta_n, pi) <= theta_w)
+                return;
+
+            auto theta_o = (theta_w + theta_d + theta_n) / 2;
+            auto side = narrow.axis - dot(wide.axis, narrow.axis) * wide.axis;
+            if(theta_o >= pi || side.length_squared() < 1e-12) {
+                n.cos_o = -1;
+                n.sin_o = 0;
+                return;
+            }
+
+            // Turn the wide axis towards the narrow one until the new cone touches both
+            auto turn = theta_o - theta_w;
+            n.axis = cos(turn) * wide.axis + sin(turn) * unit_vector(side);
+            n.cos_o = cos(theta_o);
+            n.sin_o = sin(theta_o);
+        }
+
+        static point3 centroid(const aabb& box) {
+            return point3(box.x.min + box.x.max, box.y.min + box.y.max, box.z.min + box.z.max) / 2;
+        }
+
+        static double importance(const node& n, const point3& origin) {
+            // Power over squared distance, times the best cosine any light in the node can have
+            // towards 'origin': the angle to the cone axis, less the cone and less the angle the
+            // node's bounding sphere subtends. Diffuse emitters do not shine past 90 degrees.
+            // Angles are combined as cosines and sines, no trigonometric calls.
+            // Distances are clamped to the node's size, so points inside a cluster do not blow up.
+            if(n.power <= 0)
+                return 0;
+
+            auto to_origin = origin - n.center;
+            double distance_squared = to_origin.length_squared();
+            if(distance_squared <= n.radius_squared)
+                return n.power / fmax(n.radius_squared, 1e-12);
+            if(n.cos_o <= -1)
+                return n.power / distance_squared;
+
+            // theta_x = max(0, theta - theta_o)
+            auto cos_theta = dot(n.axis, to_origin) / sqrt(distance_squared);
+            auto sin_theta = sqrt(fmax(0.0, 1 - cos_theta * cos_theta));
+            double cos_x = 1, sin_x = 0;
+            if(cos_theta < n.cos_o) {
+                cos_x = cos_theta * n.cos_o + sin_theta * n.sin_o;
+                sin_x = sin_theta * n.cos_o - cos_theta * n.sin_o;
+            }
+
+            // cos(max(0, theta_x - theta_u))
+            auto sin_u_squared = n.radius_squared / distance_squared;
+            auto cos_u = sqrt(1 - sin_u_squared);
+            auto cos_min = (cos_x >= cos_u) ? 1.0 : cos_x * cos_u + sin_x * sqrt(sin_u_squared);
+            if(cos_min <= 0)
+                return 0;
+            return n.power * cos_min / distance_squared;
+        }
+
+        double left_probability(const node& n, const point3& origin) const {
+            auto left = importance(nodes[n.left], origin);
+            auto right = importance(nodes[n.right], origin);
+            if(left + right > 0)
+                return left / (left + right);
+
+            // No light below faces the point, fall back to power so some light is still picked
+            auto left_power = nodes[n.left].power;
+            auto total = left_power + nodes[n.right].power;
+            return total > 0 ? left_power / total : 0.5;
+        }
+
+        bool node_hit(int index, const ray& r, interval& ray_t, hit_record& rec) const {
+            const node& n = nodes[index];
+            if(!n.box.hit(r, ray_t))
+                return false;
+            if(n.light >= 0) {
+                if(!lights[n.light]->hit(r, ray_t, rec))
+                    return false;
+                ray_t.max = rec.t;
+                return true;
+            }
+            bool hit_left = node_hit(n.left, r, ray_t, rec);
+            return node_hit(n.right, r, ray_t, rec) || hit_left;
+        }
+
+        double node_pdf(int index, const ray& r, double probability) const {
+            const node& n = nodes[index];
+            if(!n.box.hit(r, interval(0.001, infinity)))
+                return 0.0;
+            if(n.light >= 0)
+                return probability * lights[n.light]->pdf_value(r.origin(), r.direction());
+
+            auto p_left = left_probability(n, r.origin());
+            auto sum = 0.0;
+            if(p_left > 0)
+                sum += node_pdf(n.left, r, probability * p_left);
+            if(p_left < 1)
+                sum += node_pdf(n.right, r, probability * (1 - p_left));
+            return sum;
+        }
+};
+
+#endif
@@ -0,0 +1,560 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include "../Helper/rtweekend.h"
+
+#include "hittable.h"
+#include "triangle_pack.h"
+#include "../Bounding_Volume_Hierarchies/bvh.h"
+#include "../Bounding_Volume_Hierarchies/linear_bvh.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Indexed triangle mesh: shared position, normal and texture coordinate arrays, three vertex
+// indices per triangle and one material for the whole mesh. Triangles are addressed by index
+// from a BVH of linear_bvh nodes built over the mesh, each leaf holds its triangles' vertices
+// in a triangle_pack for the SIMD intersection test. A triangle thus costs its indices, its
+// share of the nodes and its pack lane instead of one heap object. The positions are only
+// kept in the packs, normals and uvs are looked up through the indices.
+class triangle_mesh : public hittable {
+    public:
+        struct texcoord {
+            float u, v;
+        };
+
+        using node = linear_bvh::node;
+        using pack = triangle_pack<real, triangle_pack_width>;
+
+        static const int stack_size = linear_bvh::stack_size;
+        static const int max_leaf_size = triangle_pack_width; // One pack per leaf
+
+        // 'normals' and 'uvs' are per vertex and optional (empty: flat shading, barycentric uv).
+        // The index buffer is reordered to the BVH's triangle order.
+        triangle_mesh(const std::vector<point3>& positions, std::vector<uint32_t> indices, shared_ptr<material> mat,
+                      std::vector<vec3> normals = {}, std::vector<texcoord> uvs = {},
+                      const bvh_options& options = bvh_node::default_options)
+         : normals(std::move(normals)), uvs(std::move(uvs)), indices(std::move(indices)), mat(mat) {
+            build(positions, options);
+            if(options.report) {
+                std::clog << "Triangle mesh: " << triangle_count() << " triangles, " << positions.size()
+                          << " vertices, " << nodes.size() << " nodes, " << memory_footprint() << " bytes\n";
+            }
+        }
+
+        bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+            // Same front-to-back traversal as linear_bvh. The closest triangle is recorded by its
+            // pack and lane with the barycentrics in u, v; finalize() turns it into a hit record.
+            struct entry {
+                int index;
+                double t;
+            };
+            entry stack[stack_size];
+            int top = 0;
+            double t_enter;
+            uint64_t visited = 1;
+
+            watertight_ray<real> wr(r);
+            int closest = -1, closest_lane = 0;
+            real b1 = 0, b2 = 0;
+            int current = (!nodes.empty() && linear_bvh::box_hit(nodes[0], r, ray_t, t_enter)) ? 0 : -1;
+
+            while(current >= 0) {
+                const node& n = nodes[current];
+
+                if(n.count > 0) {
+                    // Leaves start at pack 'offset' and hold 'count' triangles
+                    int end = n.offset + (n.count + triangle_pack_width - 1) / triangle_pack_width;
+                    for(int i = n.offset; i < end; i++) {
+                        real t, u, v;
+                        int lane = packs[i].intersect(wr, ray_t, t, u, v);
+                        if(lane >= 0) {
+                            closest = i;
+                            closest_lane = lane;
+                            ray_t.max = t;
+                            b1 = u;
+                            b2 = v;
+                        }
+                    }
+                    current = -1;
+                } else {
+                    // Left child follows its parent
+                    int a = current + 1;
+                    int b = n.offset;
+                    double t_a, t_b;
+                    bool in_a = linear_bvh::box_hit(nodes[a], r, ray_t, t_a);
+                    bool in_b = linear_bvh::box_hit(nodes[b], r, ray_t, t_b);
+                    visited += 2;
+
+                    if(in_a && in_b) {
+                        if(t_b < t_a) {
+                            std::swap(a, b);
+                            std::swap(t_a, t_b);
+                        }
+                        stack[top++] = {b, t_b};
+                        current = a;
+                    } else {
+                        current = in_a ? a : (in_b ? b : -1);
+                    }
+                }
+
+                while(current < 0 && top > 0) {
+                    const entry& e = stack[--top];
+                    if(e.t < ray_t.max)
+                        current = e.index;
+                }
+            }
+
+            bvh_nodes_visited() += visited;
+            if(closest < 0)
+                return false;
+
+            rec.t = real(ray_t.max);
+            rec.u = b1;
+            rec.v = b2;
+            rec.index = uint32_t(closest) * triangle_pack_width + uint32_t(closest_lane);
+            rec.object = this;
+            return true;
+        }
+
+        void finalize(const ray& r, hit_record& rec) const override {
+            set_hit_record(packs[rec.index / triangle_pack_width], int(rec.index % triangle_pack_width),
+                           r, rec.t, real(rec.u), real(rec.v), rec);
+        }
+
+        bool occluded(const ray& r, interval ray_t) const override {
+            // Unordered traversal, stops at the first pack with a hit in range
+            int stack[stack_size];
+            int top = 0;
+            double t_enter;
+            uint64_t visited = 1;
+            bool blocked = false;
+
+            watertight_ray<real> wr(r);
+            int current = (!nodes.empty() && linear_bvh::box_hit(nodes[0], r, ray_t, t_enter)) ? 0 : -1;
+
+            while(current >= 0 && !blocked) {
+                const node& n = nodes[current];
+
+                if(n.count > 0) {
+                    int end = n.offset + (n.count + triangle_pack_width - 1) / triangle_pack_width;
+                    for(int i = n.offset; i < end && !blocked; i++) {
+                        real t, u, v;
+                        blocked = packs[i].intersect(wr, ray_t, t, u, v) >= 0;
+                    }
+                    current = -1;
+                } else {
+                    int a = current + 1;
+                    int b = n.offset;
+                    bool in_a = linear_bvh::box_hit(nodes[a], r, ray_t, t_enter);
+                    bool in_b = linear_bvh::box_hit(nodes[b], r, ray_t, t_enter);
+                    visited += 2;
+
+                    if(in_a && in_b)
+                        stack[top++] = b;
+                    current = in_a ? a : (in_b ? b : -1);
+                }
+
+                if(current < 0 && top > 0)
+                    current = stack[--top];
+            }
+
+            bvh_nodes_visited() += visited;
+            return blocked;
+        }
+
+        aabb bounding_box() const override {return bbox;}
+
+        point3 center(double time) override {
+            return point3(bbox.x.min + bbox.x.max, bbox.y.min + bbox.y.max, bbox.z.min + bbox.z.max) / 2;
+        }
+
+        size_t triangle_count() const {return indices.size() / 3;}
+
+        size_t memory_footprint() const {
+            return normals.size() * sizeof(vec3) + uvs.size() * sizeof(texcoord)
+                 + indices.size() * sizeof(uint32_t) + nodes.size() * sizeof(node) + packs.size() * sizeof(pack);
+        }
+
+    private:
+        std::vector<vec3>     normals;
+        std::vector<texcoord> uvs;
+        std::vector<uint32_t> indices; // Three per triangle, in BVH leaf order
+        std::vector<node>     nodes;
+        std::vector<pack>     packs;
+        shared_ptr<material>  mat;
+        aabb bbox;
+
+        void set_hit_record(const pack& pk, int lane, const ray& r, real t, real b1, real b2, hit_record& rec) const {
+            size_t tri = pk.first + lane;
+            uint32_t i0 = indices[3*tri], i1 = indices[3*tri + 1], i2 = indices[3*tri + 2];
+            real b0 = 1 - b1 - b2;
+
+            // Hit point from the barycentrics, it lies on the triangle unlike r.at(t)
+            point3 p0 = pk.vertex(0, lane);
+            point3 p1 = pk.vertex(1, lane);
+            point3 p2 = pk.vertex(2, lane);
+            rec.p = b0 * p0 + b1 * p1 + b2 * p2;
+            rec.mat = mat.get();
+
+            // Counter-clockwise winding faces outwards. Shading normals keep the side of the geometric one.
+            rec.set_face_normal(r, unit_vector(cross(p1 - p0, p2 - p0)));
+            if(!normals.empty()) {
+                vec3 shading = unit_vector(b0 * normals[i0] + b1 * normals[i1] + b2 * normals[i2]);
+                rec.normal = rec.front_face ? shading : -shading;
+            }
+
+            if(uvs.empty()) {
+                rec.u = b1;
+                rec.v = b2;
+            } else {
+                rec.u = b0 * uvs[i0].u + b1 * uvs[i1].u + b2 * uvs[i2].u;
+                rec.v = b0 * uvs[i0].v + b1 * uvs[i1].v + b2 * uvs[i2].v;
+            }
+        }
+
+        // BVH Construction
+        // Triangle boxes and centroids only live during the build. 'order' holds triangle ids and
+        // is partitioned like bvh_node partitions its objects; leaves cover contiguous runs of it.
+        struct build_state {
+            std::vector<aabb> boxes;
+            std::vector<point3> centroids;
+            std::vector<uint32_t> order;
+            bvh_options options;
+        };
+
+        void build(const std::vector<point3>& positions, const bvh_options& options) {
+            size_t count = triangle_count();
+            bbox = aabb::empty;
+            if(count == 0)
+                return;
+
+            build_state state;
+            state.options = options;
+            state.boxes.resize(count);
+            state.centroids.resize(count);
+            state.order.resize(count);
+            for(size_t i = 0; i < count; i++) {
+                const point3& p0 = positions[indices[3*i]];
+                const point3& p1 = positions[indices[3*i + 1]];
+                const point3& p2 = positions[indices[3*i + 2]];
+                state.boxes[i] = aabb(aabb(p0, p1), aabb(p2, p2));
+                state.centroids[i] = (p0 + p1 + p2) / 3;
+                state.order[i] = uint32_t(i);
+                bbox = aabb(bbox, state.boxes[i]);
+            }
+
+            nodes.reserve(2 * count / max_leaf_size + 1);
+            build_node(state, 0, count, 0);
+
+            // Index buffer in leaf order, so leaves address their triangles by offset and count
+            std::vector<uint32_t> sorted(indices.size());
+            for(size_t i = 0; i < count; i++)
+                for(int k = 0; k < 3; k++)
+                    sorted[3*i + k] = indices[3*state.order[i] + k];
+            indices.swap(sorted);
+            nodes.shrink_to_fit();
+
+            // Vertices of each leaf's triangles copied into packs, leaves then point at their first pack
+            for(node& n : nodes) {
+                if(n.count == 0)
+                    continue;
+                int first = n.offset;
+                n.offset = int32_t(packs.size());
+                for(int done = 0; done < n.count; done += triangle_pack_width) {
+                    packs.emplace_back();
+                    pack& pk = packs.back();
+                    pk.first = uint32_t(first + done);
+                    pk.count = std::min(triangle_pack_width, n.count - done);
+                    for(int lane = 0; lane < triangle_pack_width; lane++) {
+                        size_t tri = first + done + std::min(lane, pk.count - 1);
+                        pk.set(lane, positions[indices[3*tri]], positions[indices[3*tri + 1]], positions[indices[3*tri + 2]]);
+                    }
+                }
+            }
+        }
+
+        int build_node(build_state& state, size_t start, size_t end, int depth) {
+            auto index = int(nodes.size());
+            nodes.push_back(node());
+
+            aabb box = aabb::empty;
+            aabb centroid_box = aabb::empty;
+            for(size_t i = start; i < end; i++) {
+                box = aabb(box, state.boxes[state.order[i]]);
+                const point3& c = state.centroids[state.order[i]];
+                centroid_box = aabb(centroid_box, aabb(interval(c.x(), c.x()), interval(c.y(), c.y()), interval(c.z(), c.z())));
+            }
+            linear_bvh::set_bounds(nodes[index], box);
+
+            size_t count = end - start;
+            size_t mid = start;
+            bool leaf = count <= max_leaf_size || depth >= stack_size - 1;
+            if(!leaf) {
+                // Median splits halve the count, so they reach leaf size within the traversal stack.
+                // Once the depth left only just allows that, unbalanced SAH splits are no longer taken.
+                bool sah = state.options.split == bvh_options::sah && depth + median_levels(count) < stack_size - 1;
+                mid = sah
+                    ? sah_partition(state, start, end, box, centroid_box)
+                    : median_partition(state, start, end, centroid_box);
+                // No split is cheaper than a leaf (only taken while the leaf size fits the node)
+                leaf = (mid == start || mid == end) && count <= UINT16_MAX;
+                if(!leaf && (mid == start || mid == end))
+                    mid = median_partition(state, start, end, centroid_box);
+            }
+
+            if(leaf) {
+                nodes[index].offset = int32_t(start);
+                nodes[index].count = uint16_t(count);
+                return index;
+            }
+
+            build_node(state, start, mid, depth + 1);
+            int right = build_node(state, mid, end, depth + 1);
+            nodes[index].offset = right;
+            nodes[index].count = 0;
+            return index;
+        }
+
+        static int median_levels(size_t count) {
+            // Depth of a median split tree over count triangles
+            int levels = 0;
+            for(; count > max_leaf_size; count = (count + 1) / 2)
+                levels++;
+            return levels;
+        }
+
+        static size_t median_partition(build_state& state, size_t start, size_t end, const aabb& centroid_box) {
+            int axis = centroid_box.longest_axis();
+            auto first = state.order.begin();
+            std::nth_element(first + start, first + (start + end) / 2, first + end, [&](uint32_t a, uint32_t b) {
+                return state.centroids[a][axis] < state.centroids[b][axis];
+            });
+            return (start + end) / 2;
+        }
+
+        static size_t sah_partition(build_state& state, size_t start, size_t end, const aabb& box, const aabb& centroid_box) {
+            // Binned SAH as in bvh_node, returns start when keeping a leaf is cheaper than any split
+            struct bin {
+                aabb box;
+                int count = 0;
+            };
+
+            const bvh_options& options = state.options;
+            int bin_count = options.bins < 2 ? 2 : options.bins;
+            std::vector<bin> bins(bin_count);
+            std::vector<double> right_area(bin_count);
+            std::vector<int> right_count(bin_count);
+
+            int best_axis = -1;
+            int best_border = 0;
+            double best_cost = infinity;
+
+            for(int axis = 0; axis < 3; axis++) {
+                const interval& extent = centroid_box.axis_interval(axis);
+                if(extent.size() <= 0)
+                    continue;
+
+                std::fill(bins.begin(), bins.end(), bin());
+                for(size_t i = start; i < end; i++) {
+                    uint32_t tri = state.order[i];
+                    auto& b = bins[bin_index(state.centroids[tri][axis], extent, bin_count)];
+                    b.box = aabb(b.box, state.boxes[tri]);
+                    b.count++;
+                }
+
+                aabb acc = aabb::empty;
+                int count = 0;
+                for(int border = bin_count - 1; border > 0; border--) {
+                    acc = aabb(acc, bins[border].box);
+                    count += bins[border].count;
+                    right_area[border] = count ? acc.surface_area() : 0;
+                    right_count[border] = count;
+                }
+
+                acc = aabb::empty;
+                count = 0;
+                for(int border = 1; border < bin_count; border++) {
+                    acc = aabb(acc, bins[border - 1].box);
+                    count += bins[border - 1].count;
+                    if(count == 0 || right_count[border] == 0)
+                        continue;
+
+                    double cost = acc.surface_area() * count + right_area[border] * right_count[border];
+                    if(cost < best_cost) {
+                        best_cost = cost;
+                        best_axis = axis;
+                        best_border = border;
+                    }
+                }
+            }
+
+            if(best_axis < 0)
+                return start;
+
+            // Split only if it beats testing every triangle of the node
+            double area = box.surface_area();
+            double split_cost = options.traversal_cost + options.intersection_cost * best_cost / area;
+            double leaf_cost = options.intersection_cost * double(end - start);
+            if(area > 0 && split_cost >= leaf_cost)
+                return start;
+
+            const interval& extent = centroid_box.axis_interval(best_axis);
+            auto mid = std::partition(state.order.begin() + start, state.order.begin() + end, [&](uint32_t tri) {
+                return bin_index(state.centroids[tri][best_axis], extent, bin_count) < best_border;
+            });
+            return size_t(mid - state.order.begin());
+        }
+
+        static int bin_index(double c, const interval& extent, int bin_count) {
+            int index = int(bin_count * (c - extent.min) / extent.size());
+            return index < 0 ? 0 : (index >= bin_count ? bin_count - 1 : index);
+        }
+};
+
+inline shared_ptr<triangle_mesh> sphere_mesh(const point3& center, double radius, int segments, shared_ptr<material> mat) {
+    // Tessellated sphere of segments x segments/2 quads with smooth normals and the uv mapping of sphere
+    int rings = std::max(2, segments / 2);
+    segments = std::max(3, segments);
+
+    std::vector<point3> positions;
+    std::vector<vec3> normals;
+    std::vector<triangle_mesh::texcoord> uvs;
+    for(int r = 0; r <= rings; r++) {
+        // Exact poles and seam (the last column repeats the first), so the mesh has no cracks
+        double theta = pi * r / rings;
+        double sin_theta = (r == 0 || r == rings) ? 0 : sin(theta);
+        for(int s = 0; s <= segments; s++) {
+            double phi = 2 * pi * (s % segments) / segments;
+            vec3 n(-cos(phi) * sin_theta, -cos(theta), sin(phi) * sin_theta);
+            positions.push_back(center + radius * n);
+            normals.push_back(n);
+            uvs.push_back({float(double(s) / segments), float(double(r) / rings)});
+        }
+    }
+
+    std::vector<uint32_t> indices;
+    auto vertex = [&](int r, int s) {return uint32_t(r * (segments + 1) + s);};
+    for(int r = 0; r < rings; r++) {
+        for(int s = 0; s < segments; s++) {
+            uint32_t a = vertex(r, s), b = vertex(r, s + 1), c = vertex(r + 1, s), d = vertex(r + 1, s + 1);
+            // The pole rows would give degenerate triangles
+            if(r > 0)
+                indices.insert(indices.end(), {a, b, c});
+            if(r < rings - 1)
+                indices.insert(indices.end(), {b, d, c});
+        }
+    }
+    return make_shared<triangle_mesh>(std::move(positions), std::move(indices), mat, std::move(normals), std::move(uvs));
+}
+
+inline shared_ptr<triangle_mesh> load_obj(const std::string& filename, shared_ptr<material> mat,
+                                          const bvh_options& options = bvh_node::default_options) {
+    // Minimal Wavefront OBJ reader: v, vt, vn and polygonal f lines (fanned into triangles),
+    // everything else is ignored. Vertices are shared between faces that use the same v/vt/vn
+    // combination. Normals and uvs are kept only if every face vertex has one.
+    std::ifstream file(filename);
+    if(!file) {
+        std::cerr << "ERROR: Could not load mesh file '" << filename << "'.\n";
+        return nullptr;
+    }
+
+    std::vector<point3> file_positions;
+    std::vector<vec3> file_normals;
+    std::vector<triangle_mesh::texcoord> file_uvs;
+
+    struct corner {
+        int v, vt, vn;
+        bool operator==(const corner& o) const {return v == o.v && vt == o.vt && vn == o.vn;}
+    };
+    struct corner_hash {
+        size_t operator()(const corner& c) const {
+            return std::hash<uint64_t>()((uint64_t(uint32_t(c.v)) << 32) ^ (uint64_t(uint32_t(c.vt)) << 16) ^ uint32_t(c.vn));
+        }
+    };
+    std::unordered_map<corner, uint32_t, corner_hash> shared;
+    std::vector<corner> corners;
+    std::vector<uint32_t> indices;
+    bool all_uvs = true, all_normals = true;
+
+    auto resolve = [](int index, size_t count) {
+        // 1-based, negative counts back from the last element read so far
+        return index > 0 ? index - 1 : int(count) + index;
+    };
+
+    std::string line;
+    std::vector<uint32_t> face;
+    while(std::getline(file, line)) {
+        std::istringstream in(line);
+        std::string type;
+        in >> type;
+        if(type == "v") {
+            double x = 0, y = 0, z = 0;
+            in >> x >> y >> z;
+            file_positions.push_back(point3(x, y, z));
+        } else if(type == "vn") {
+            double x = 0, y = 0, z = 0;
+            in >> x >> y >> z;
+            file_normals.push_back(vec3(x, y, z));
+        } else if(type == "vt") {
+            float u = 0, v = 0;
+            in >> u >> v;
+            file_uvs.push_back({u, v});
+        } else if(type == "f") {
+            face.clear();
+            std::string token;
+            while(in >> token) {
+                // v, v/vt, v//vn or v/vt/vn
+                corner c = {-1, -1, -1};
+                const char* s = token.c_str();
+                char* next;
+                c.v = resolve(int(strtol(s, &next, 10)), file_positions.size());
+                if(*next == '/') {
+                    s = next + 1;
+                    if(*s != '/')
+                        c.vt = resolve(int(strtol(s, &next, 10)), file_uvs.size());
+                    else
+                        next = const_cast<char*>(s);
+                    if(*next == '/')
+                        c.vn = resolve(int(strtol(next + 1, &next, 10)), file_normals.size());
+                }
+                if(c.v < 0 || c.v >= int(file_positions.size())
+                    || c.vt >= int(file_uvs.size()) || c.vn >= int(file_normals.size())) {
+                    std::cerr << "ERROR: Invalid face '" << line << "' in mesh file '" << filename << "'.\n";
+                    return nullptr;
+                }
+                all_uvs = all_uvs && c.vt >= 0;
+                all_normals = all_normals && c.vn >= 0;
+
+                auto found = shared.emplace(c, uint32_t(corners.size()));
+                if(found.second)
+                    corners.push_back(c);
+                face.push_back(found.first->second);
+            }
+            for(size_t k = 2; k < face.size(); k++)
+                indices.insert(indices.end(), {face[0], face[k - 1], face[k]});
+        }
+    }
+    shared = {};
+
+    std::vector<point3> positions;
+    std::vector<vec3> normals;
+    std::vector<triangle_mesh::texcoord> uvs;
+    positions.reserve(corners.size());
+    for(const corner& c : corners) {
+        positions.push_back(file_positions[c.v]);
+        if(all_normals)
+            normals.push_back(file_normals[c.vn]);
+        if(all_uvs)
+            uvs.push_back(file_uvs[c.vt]);
+    }
+    return make_shared<triangle_mesh>(std::move(positions), std::move(indices), mat, std::move(normals), std::move(uvs), options);
+}
+
+#endif
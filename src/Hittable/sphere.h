@@ -27,38 +27,73 @@ class sphere : public hittable {
 
 
         bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-            point3 center = is_moving ? sphere_center(r.time()) : center1;
-            vec3 oc = center - r.origin();
-            auto a = r.direction().length_squared();
-            auto h = dot(r.direction(), oc);
-            auto c = oc.length_squared() - radius*radius;
-
-            auto discriminant = h*h - a*c;
-            if (discriminant < 0)
+            double near_root, far_root;
+            if (!roots(r, is_moving ? sphere_center(r.time()) : center1, near_root, far_root))
                 return false;
-            
-            auto sqrtd = sqrt(discriminant);
 
             // Find nearest root in acceptable range
-            auto root = (h - sqrtd) / a;
+            auto root = near_root;
             if (!ray_t.surrounds(root)) {
-                root = (h + sqrtd) / a;
+                root = far_root;
                 if (!ray_t.surrounds(root))
                     return false;
             }
 
+            // Normal, uv and material wait for finalize()
             rec.t = root;
-            rec.p = r.at(rec.t);
-            vec3 outward_normal = (rec.p - center) / radius;
-            rec.set_face_normal(r, outward_normal);
-            get_sphere_uv(outward_normal, rec.u, rec.v);
-            rec.mat = mat;
+            rec.object = this;
 
             return true;
         }
 
+        bool occluded(const ray& r, interval ray_t) const override {
+            // Either root in range, no hit record
+            double near_root, far_root;
+            if (!roots(r, is_moving ? sphere_center(r.time()) : center1, near_root, far_root))
+                return false;
+            return ray_t.surrounds(near_root) || ray_t.surrounds(far_root);
+        }
+
+        void hit_packet(ray_packet& packet, double t_min) const override {
+            // Roots for all rays in one branch-free pass, then t for the accepted rays
+            double root[ray_packet::max_size];
+
+            for(int i = 0; i < packet.size; i++) {
+                const ray& r = packet.rays[i];
+                point3 center = center1 + (is_moving ? r.time() : 0.0)*center_vec;
+                double near_root, far_root;
+                bool found = roots(r, center, near_root, far_root);
+
+                bool near_ok = t_min < near_root && near_root < packet.t_max[i];
+                bool far_ok = t_min < far_root && far_root < packet.t_max[i];
+                root[i] = !found ? infinity : near_ok ? near_root : far_ok ? far_root : infinity;
+            }
+
+            for(int i = 0; i < packet.size; i++) {
+                if(!packet.active[i] || root[i] == infinity)
+                    continue;
+                packet.rec[i].t = root[i];
+                packet.rec[i].object = this;
+                packet.found[i] = true;
+                packet.t_max[i] = root[i];
+            }
+        }
+
+        void finalize(const ray& r, hit_record& rec) const override {
+            set_record(r, is_moving ? sphere_center(r.time()) : center1, rec);
+        }
+
         aabb bounding_box() const override {return bbox;}
 
+        bool motion_bounds(double t0, double t1, aabb& open, aabb& close) const override {
+            if(!is_moving)
+                return hittable::motion_bounds(t0, t1, open, close);
+            auto rvec = vec3(radius, radius, radius);
+            open = aabb(sphere_center(t0) - rvec, sphere_center(t0) + rvec);
+            close = aabb(sphere_center(t1) - rvec, sphere_center(t1) + rvec);
+            return true;
+        }
+
         double pdf_value(const point3& origin, const vec3& direction) const override {
             // Only works for stationary spheres
             hit_record rec;
@@ -93,6 +128,40 @@ class sphere : public hittable {
             return center1 + time*center_vec;
         }
 
+        bool roots(const ray& r, const point3& center, double& near_root, double& far_root) const {
+            // Both roots in double, in the stable form of Ray Tracing Gems ch. 7: the discriminant
+            // from the distance of the center to the ray's line, and the root nearer zero as c/q.
+            // Otherwise a large sphere (a ground plane of radius 1000) loses its roots to
+            // cancellation in the float build and rays leaving it hit it again.
+            vec3_t<double> d(r.direction());
+            vec3_t<double> oc = vec3_t<double>(center) - vec3_t<double>(r.origin());
+            auto a = d.length_squared();
+            auto h = dot(d, oc);
+            auto c = oc.length_squared() - radius*radius;
+
+            auto closest = oc - (h / a) * d;
+            auto discriminant = a * (radius*radius - closest.length_squared());
+            if (discriminant < 0)
+                return false;
+
+            auto q = h + std::copysign(sqrt(discriminant), h);
+            if (q == 0) {
+                near_root = far_root = 0;
+                return true;
+            }
+            near_root = fmin(q / a, c / q);
+            far_root = fmax(q / a, c / q);
+            return true;
+        }
+
+        void set_record(const ray& r, const point3& center, hit_record& rec) const {
+            rec.p = r.at(rec.t);
+            vec3 outward_normal = (rec.p - center) / radius;
+            rec.set_face_normal(r, outward_normal);
+            get_sphere_uv(outward_normal, rec.u, rec.v);
+            rec.mat = mat.get();
+        }
+
         static void get_sphere_uv(const point3& p, double& u, double& v) {
             // p: Given point of radius one, centered at origin
             // u: returned value [0,1] around Y axis from X = -1
@@ -25,7 +25,7 @@ class quad : public hittable {
         virtual void set_bounding_box() {
             auto bbox_diagonal1 = aabb(Q, Q+u+v);
             auto bbox_diagonal2 = aabb(Q+u, Q+v);
-            bbox = aabb(bbox_diagonal1, bbox_diagonal1);
+            bbox = aabb(bbox_diagonal1, bbox_diagonal2);
         }
 
         aabb bounding_box() const override {return bbox;}
@@ -51,15 +51,67 @@ class quad : public hittable {
             if(!is_interior(alpha, beta, rec))
                 return false;
 
-            // Ray hits 2D shape
+            // Ray hits 2D shape, is_interior() has set the uv
             rec.t = t;
-            rec.p = intersection;
-            rec.mat = mat;
-            rec.set_face_normal(r, normal);
+            rec.object = this;
 
             return true;
         }
 
+        void finalize(const ray& r, hit_record& rec) const override {
+            rec.p = r.at(rec.t);
+            rec.mat = mat.get();
+            rec.set_face_normal(r, normal);
+        }
+
+        bool occluded(const ray& r, interval ray_t) const override {
+            // Same test, the record only takes the shape's uv
+            auto denom = dot(normal, r.direction());
+            if(fabs(denom) < 1e-8)
+                return false;
+
+            auto t = (D - dot(normal, r.origin())) / denom;
+            if(!ray_t.contains(t))
+                return false;
+
+            vec3 planar_hitpt_vector = r.at(t) - Q;
+            hit_record rec;
+            return is_interior(dot(w, cross(planar_hitpt_vector, v)), dot(w, cross(u, planar_hitpt_vector)), rec);
+        }
+
+        void hit_packet(ray_packet& packet, double t_min) const override {
+            // Plane distances and planar coordinates for all rays in one pass, then the
+            // shape test for the rays that reach the plane in range
+            double t[ray_packet::max_size];
+            double alpha[ray_packet::max_size];
+            double beta[ray_packet::max_size];
+
+            for(int i = 0; i < packet.size; i++) {
+                const ray& r = packet.rays[i];
+                auto denom = dot(normal, r.direction());
+                t[i] = (D - dot(normal, r.origin())) / denom;
+                bool in_range = fabs(denom) >= 1e-8 && t_min <= t[i] && t[i] <= packet.t_max[i];
+                t[i] = in_range ? t[i] : infinity;
+
+                vec3 planar_hitpt_vector = r.at(t[i]) - Q;
+                alpha[i] = dot(w, cross(planar_hitpt_vector, v));
+                beta[i] = dot(w, cross(u, planar_hitpt_vector));
+            }
+
+            for(int i = 0; i < packet.size; i++) {
+                if(!packet.active[i] || t[i] == infinity)
+                    continue;
+                hit_record& rec = packet.rec[i];
+                if(!is_interior(alpha[i], beta[i], rec))
+                    continue;
+
+                rec.t = t[i];
+                rec.object = this;
+                packet.found[i] = true;
+                packet.t_max[i] = t[i];
+            }
+        }
+
         virtual bool is_interior(double a, double b, hit_record& rec) const {
             // Can be adapted to fit any 2D-Shape
             interval unit_interval = interval(0, 1);
@@ -79,7 +131,7 @@ class quad : public hittable {
                 return 0.0;
             
             auto distance_squared = rec.t * rec.t * direction.length_squared();
-            auto cosine = fabs(dot(direction, rec.normal) / direction.length());
+            auto cosine = fabs(dot(direction, normal) / direction.length());
 
             return distance_squared / (cosine * area);
         }
@@ -92,6 +144,12 @@ class quad : public hittable {
 
         point3 center(double time) override {return cPoint;}
 
+        void emission_cone(vec3& axis, double& spread) const override {
+            // Emitters only shine on their front side
+            axis = normal;
+            spread = 0;
+        }
+
     private:
         point3 Q;
         vec3 u, v;
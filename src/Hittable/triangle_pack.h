@@ -0,0 +1,188 @@
+#ifndef TRIANGLE_PACK_H
+#define TRIANGLE_PACK_H
+
+#include "../Helper/rtweekend.h"
+#include "../Helper/simd.h"
+
+#include <cstdint>
+#include <type_traits>
+
+// Watertight ray-triangle intersection (Woop, Benthin, Wald: "Watertight Ray/Triangle
+// Intersection", JCGT 2013). The ray is permuted so its largest direction component is z and
+// sheared to point along z. Each triangle is then projected into the ray's 2D space, where the
+// three edge functions U, V, W decide the hit. Shared edges are evaluated on the same vertex
+// values by both triangles, so a ray through an edge or a vertex cannot slip between them.
+
+// Lanes per triangle_pack: 8 floats with AVX, otherwise 4
+#if defined(__AVX__)
+constexpr int triangle_pack_width = sizeof(real) == sizeof(float) ? 8 : 4;
+#else
+constexpr int triangle_pack_width = 4;
+#endif
+
+template <typename T>
+class watertight_ray {
+    public:
+        int kx, ky, kz; // Axis permutation, kz is the largest direction component
+        T sx, sy, sz;   // Shear
+        T ox, oy, oz;   // Origin, permuted
+
+        watertight_ray(const ray_t<T>& r) {
+            const vec3_t<T>& d = r.direction();
+            T ax = std::fabs(d.x()), ay = std::fabs(d.y()), az = std::fabs(d.z());
+            kz = (ax > ay) ? (ax > az ? 0 : 2) : (ay > az ? 1 : 2);
+            kx = (kz + 1) % 3;
+            ky = (kx + 1) % 3;
+            // Keep the winding direction of the triangles
+            if(d[kz] < 0)
+                std::swap(kx, ky);
+
+            sx = d[kx] / d[kz];
+            sy = d[ky] / d[kz];
+            sz = 1 / d[kz];
+            ox = r.origin()[kx];
+            oy = r.origin()[ky];
+            oz = r.origin()[kz];
+        }
+};
+
+namespace watertight {
+    template <typename T>
+    inline T edge(T ax, T ay, T bx, T by) {
+        // 2D cross product, recomputed in double for float edges that come out exactly 0
+        T e = ax * by - ay * bx;
+        if constexpr (std::is_same<T, float>::value) {
+            if(e == 0)
+                e = T(double(ax) * double(by) - double(ay) * double(bx));
+        }
+        return e;
+    }
+}
+
+// Scalar test of one triangle, t in the open interval ray_t. b1 and b2 are the barycentric
+// weights of p1 and p2.
+template <typename T>
+inline bool intersect_triangle(const vec3_t<T>& p0, const vec3_t<T>& p1, const vec3_t<T>& p2,
+                               const watertight_ray<T>& r, const interval_t<T>& ray_t, T& t, T& b1, T& b2) {
+    T az = p0[r.kz] - r.oz, bz = p1[r.kz] - r.oz, cz = p2[r.kz] - r.oz;
+    T ax = p0[r.kx] - r.ox - r.sx * az, ay = p0[r.ky] - r.oy - r.sy * az;
+    T bx = p1[r.kx] - r.ox - r.sx * bz, by = p1[r.ky] - r.oy - r.sy * bz;
+    T cx = p2[r.kx] - r.ox - r.sx * cz, cy = p2[r.ky] - r.oy - r.sy * cz;
+
+    T u = watertight::edge(cx, cy, bx, by);
+    T v = watertight::edge(ax, ay, cx, cy);
+    T w = watertight::edge(bx, by, ax, ay);
+    if((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0))
+        return false;
+
+    T det = u + v + w;
+    if(det == 0)
+        return false;
+
+    T hit_t = r.sz * (u * az + v * bz + w * cz) / det;
+    if(!ray_t.surrounds(hit_t))
+        return false;
+
+    t = hit_t;
+    b1 = v / det;
+    b2 = w / det;
+    return true;
+}
+
+// Up to N triangles in structure-of-arrays form, one ray is tested against all of them at once
+template <typename T, int N>
+struct alignas(N * sizeof(T) >= 32 ? 32 : 16) triangle_pack {
+    T        p[3][3][N]; // [vertex][axis][lane], unused lanes repeat the last triangle
+    uint32_t first = 0;  // Triangle of lane 0, the lanes follow it
+    int      count = 0;  // Lanes in use
+
+    void set(int lane, const vec3_t<T>& p0, const vec3_t<T>& p1, const vec3_t<T>& p2) {
+        for(int axis = 0; axis < 3; axis++) {
+            p[0][axis][lane] = p0[axis];
+            p[1][axis][lane] = p1[axis];
+            p[2][axis][lane] = p2[axis];
+        }
+    }
+
+    vec3_t<T> vertex(int i, int lane) const {
+        return vec3_t<T>(p[i][0][lane], p[i][1][lane], p[i][2][lane]);
+    }
+
+    // Lane of the closest hit in the open interval ray_t, or -1. Same result as intersect_triangle()
+    // on each lane.
+    int intersect(const watertight_ray<T>& r, const interval_t<T>& ray_t, T& t, T& b1, T& b2) const {
+        using lanes = simd<T, N>;
+        const lanes zero = lanes::broadcast(0);
+        const lanes sx = lanes::broadcast(r.sx), sy = lanes::broadcast(r.sy);
+
+        // Vertices relative to the origin, sheared into the ray's space
+        lanes x[3], y[3], z[3];
+        for(int i = 0; i < 3; i++) {
+            z[i] = lanes::load(p[i][r.kz]) - lanes::broadcast(r.oz);
+            x[i] = lanes::load(p[i][r.kx]) - lanes::broadcast(r.ox) - sx * z[i];
+            y[i] = lanes::load(p[i][r.ky]) - lanes::broadcast(r.oy) - sy * z[i];
+        }
+
+        lanes u = x[2] * y[1] - y[2] * x[1];
+        lanes v = x[0] * y[2] - y[0] * x[2];
+        lanes w = x[1] * y[0] - y[1] * x[0];
+        int valid = (1 << count) - 1;
+
+        if constexpr (std::is_same<T, float>::value) {
+            // Edges exactly on the ray are recomputed in double, as in the scalar test
+            int flat = (equal(u, zero) | equal(v, zero) | equal(w, zero)) & valid;
+            if(flat) {
+                alignas(32) T us[N], vs[N], ws[N];
+                T xs[3][N], ys[3][N];
+                u.store(us);
+                v.store(vs);
+                w.store(ws);
+                for(int i = 0; i < 3; i++) {
+                    x[i].store(xs[i]);
+                    y[i].store(ys[i]);
+                }
+                for(int k = 0; k < N; k++) {
+                    if(!(flat & (1 << k)))
+                        continue;
+                    us[k] = watertight::edge(xs[2][k], ys[2][k], xs[1][k], ys[1][k]);
+                    vs[k] = watertight::edge(xs[0][k], ys[0][k], xs[2][k], ys[2][k]);
+                    ws[k] = watertight::edge(xs[1][k], ys[1][k], xs[0][k], ys[0][k]);
+                }
+                u = lanes::load(us);
+                v = lanes::load(vs);
+                w = lanes::load(ws);
+            }
+        }
+
+        int negative = less(u, zero) | less(v, zero) | less(w, zero);
+        int positive = greater(u, zero) | greater(v, zero) | greater(w, zero);
+        valid &= ~(negative & positive);
+        if(!valid)
+            return -1;
+
+        lanes det = u + v + w;
+        valid &= ~equal(det, zero);
+        lanes hit_t = lanes::broadcast(r.sz) * (u * z[0] + v * z[1] + w * z[2]) / det;
+        valid &= greater(hit_t, lanes::broadcast(ray_t.min)) & less(hit_t, lanes::broadcast(ray_t.max));
+        if(!valid)
+            return -1;
+
+        T ts[N];
+        hit_t.store(ts);
+        int closest = -1;
+        for(int k = 0; k < N; k++)
+            if((valid & (1 << k)) && (closest < 0 || ts[k] < ts[closest]))
+                closest = k;
+
+        T vs[N], ws[N], dets[N];
+        v.store(vs);
+        w.store(ws);
+        det.store(dets);
+        t = ts[closest];
+        b1 = vs[closest] / dets[closest];
+        b2 = ws[closest] / dets[closest];
+        return closest;
+    }
+};
+
+#endif
@@ -69,13 +69,18 @@ class constant_medium : public hittable {
             
             rec.normal = vec3(1, 0, 0); // arbitrary
             rec.front_face = true;      // arbitrary
-            rec.mat = phase_function;
+            rec.mat = phase_function.get();
+            rec.object = nullptr; // Complete, the boundary's record only lent its t
 
             return true;
         }
 
         aabb bounding_box() const override {return boundary->bounding_box();}
 
+        bool motion_bounds(double t0, double t1, aabb& open, aabb& close) const override {
+            return boundary->motion_bounds(t0, t1, open, close);
+        }
+
     private:
         shared_ptr<hittable> boundary;
         double neg_inv_density;
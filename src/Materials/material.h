@@ -13,40 +13,50 @@ class hit_record;
 class scatter_record {
     public:
         color attenuation;
-        shared_ptr<pdf> pdf_ptr;
+        const pdf* pdf_ptr = nullptr; // Usually points at one of the pdfs below
         bool skip_pdf;
         ray skip_pdf_ray;
+
+        // In-place storage for the material's pdf, so a bounce needs no heap allocation.
+        // pdf_ptr refers into the record, don't copy a record after scatter() filled it.
+        cosine_pdf cosine;
+        sphere_pdf sphere;
 };
 
+// Materials are dispatched on a type tag instead of virtual functions: emitted(), scatter() and
+// scattering_pdf() switch on kind() and call the concrete class's own function, which the
+// compiler can inline. The base behaviour (no emission, no scattering) is the default case.
+// Every material passes its kind to the constructor; a new kind needs its cases below.
 class material {
     public:
+        enum class kind_type : uint8_t {lambertian, metal, dielectric, diffuse_light, isotropic};
+        static const int kind_count = int(kind_type::isotropic) + 1;
+
         virtual ~material() = default;
 
-        virtual color emitted(
-            const ray& r_in, const hit_record& rec, double u, double v, const point3& p
-        ) const {
-            return color(0, 0, 0);
-        }
+        kind_type kind() const {return type;}
 
-        virtual bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const {
-            return false;
-        }
+        // Defined below the concrete materials
+        color emitted(const ray& r_in, const hit_record& rec, double u, double v, const point3& p) const;
+        bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const;
+        double scattering_pdf(const ray& r_in, const hit_record& rec, const ray& scattered) const;
 
-        virtual double scattering_pdf(const ray& r_in, const hit_record& rec, const ray& scattered)
-        const {
-            return 0;
-        }
+    protected:
+        explicit material(kind_type type) : type(type) {}
+
+    private:
+        kind_type type;
 };
 
 class lambertian : public material {
     public:
-        lambertian(const color& albedo) : tex(make_shared<solid_color>(albedo)) {}
-        lambertian(shared_ptr<texture> tex) : tex(tex) {}
+        lambertian(const color& albedo) : material(kind_type::lambertian), tex(make_shared<solid_color>(albedo)) {}
+        lambertian(shared_ptr<texture> tex) : material(kind_type::lambertian), tex(tex) {}
 
-        bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec)
-        const override {
+        bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const {
             srec.attenuation = tex->value(rec.u, rec.v, rec.p);
-            srec.pdf_ptr = make_shared<cosine_pdf>(rec.normal); //Random Hemispherical Sampling
+            srec.cosine = cosine_pdf(rec.normal); //Random Hemispherical Sampling
+            srec.pdf_ptr = &srec.cosine;
             srec.skip_pdf = false;
             return true;
             /*
@@ -75,10 +85,10 @@ class lambertian : public material {
 
 class metal : public material {
     public:
-        metal(const color& albedo, double fuzz) : albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1) {}
+        metal(const color& albedo, double fuzz)
+         : material(kind_type::metal), albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1) {}
 
-        bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec)
-        const override {
+        bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const {
             vec3 reflected = reflect(r_in.direction(), rec.normal);
             reflected = unit_vector(reflected) + (fuzz * random_unit_vector());
             
@@ -97,10 +107,9 @@ class metal : public material {
 
 class dielectric : public material {
     public:
-        dielectric(double refraction_index) : refraction_index(refraction_index) {}
+        dielectric(double refraction_index) : material(kind_type::dielectric), refraction_index(refraction_index) {}
 
-        bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec)
-        const override {
+        bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const {
             srec.attenuation = color(1.0, 1.0, 1.0);
             srec.pdf_ptr = nullptr;
             srec.skip_pdf = true;
@@ -135,10 +144,10 @@ class dielectric : public material {
 
 class diffuse_light : public material {
     public:
-        diffuse_light(shared_ptr<texture> tex) : tex(tex) {}
-        diffuse_light(const color& emit) : tex(make_shared<solid_color>(emit)) {}
+        diffuse_light(shared_ptr<texture> tex) : material(kind_type::diffuse_light), tex(tex) {}
+        diffuse_light(const color& emit) : material(kind_type::diffuse_light), tex(make_shared<solid_color>(emit)) {}
 
-        color emitted(const ray& r_in, const hit_record& rec, double u, double v, const point3& p) const override {
+        color emitted(const ray& r_in, const hit_record& rec, double u, double v, const point3& p) const {
             if(!rec.front_face)
                 return color(0, 0, 0);
             return tex->value(u,v,p);
@@ -150,19 +159,17 @@ class diffuse_light : public material {
 
 class isotropic : public material {
     public:
-        isotropic(const color& albedo) : tex(make_shared<solid_color>(albedo)) {}
-        isotropic(shared_ptr<texture> tex) : tex(tex) {}
+        isotropic(const color& albedo) : material(kind_type::isotropic), tex(make_shared<solid_color>(albedo)) {}
+        isotropic(shared_ptr<texture> tex) : material(kind_type::isotropic), tex(tex) {}
 
-        bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec)
-        const override {
+        bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const {
             srec.attenuation = tex->value(rec.u, rec.v, rec.p);
-            srec.pdf_ptr = make_shared<sphere_pdf>();
+            srec.pdf_ptr = &srec.sphere;
             srec.skip_pdf = false;
             return true;
         }
 
-        double scattering_pdf(const ray& r_in, const hit_record& rec, const ray& scattered)
-        const override {
+        double scattering_pdf(const ray& r_in, const hit_record& rec, const ray& scattered) const {
             return 1 / (4 * pi);
         }
 
@@ -170,4 +177,31 @@ class isotropic : public material {
         shared_ptr<texture> tex;
 };
 
+inline color material::emitted(const ray& r_in, const hit_record& rec, double u, double v, const point3& p) const {
+    switch(type) {
+        case kind_type::diffuse_light:
+            return static_cast<const diffuse_light*>(this)->emitted(r_in, rec, u, v, p);
+        default:
+            return color(0, 0, 0);
+    }
+}
+
+inline bool material::scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const {
+    switch(type) {
+        case kind_type::lambertian: return static_cast<const lambertian*>(this)->scatter(r_in, rec, srec);
+        case kind_type::metal:      return static_cast<const metal*>(this)->scatter(r_in, rec, srec);
+        case kind_type::dielectric: return static_cast<const dielectric*>(this)->scatter(r_in, rec, srec);
+        case kind_type::isotropic:  return static_cast<const isotropic*>(this)->scatter(r_in, rec, srec);
+        default:                    return false;
+    }
+}
+
+inline double material::scattering_pdf(const ray& r_in, const hit_record& rec, const ray& scattered) const {
+    switch(type) {
+        case kind_type::lambertian: return static_cast<const lambertian*>(this)->scattering_pdf(r_in, rec, scattered);
+        case kind_type::isotropic:  return static_cast<const isotropic*>(this)->scattering_pdf(r_in, rec, scattered);
+        default:                    return 0;
+    }
+}
+
 #endif
\ No newline at end of file
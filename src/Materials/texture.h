@@ -6,20 +6,32 @@
 #include "perlin.h"
 #include "../Helper/rtw_stb_image.h"
 
+// Like material: value() switches on the texture's type and calls the concrete value(), so
+// nested textures (a checker of solid colors) cost no virtual calls
 class texture {
     public:
+        enum class kind_type : uint8_t {solid_color, checker, image, noise};
+
         virtual ~texture() = default;
 
-        virtual color value(double u, double v, const point3& p) const = 0;
+        kind_type kind() const {return type;}
+
+        color value(double u, double v, const point3& p) const; // Defined below the concrete textures
+
+    protected:
+        explicit texture(kind_type type) : type(type) {}
+
+    private:
+        kind_type type;
 };
 
 class solid_color : public texture {
     public:
-        solid_color(const color& albedo) : albedo(albedo) {}
+        solid_color(const color& albedo) : texture(kind_type::solid_color), albedo(albedo) {}
 
         solid_color(double red, double green, double blue) : solid_color(color(red, green, blue)) {}
 
-        color value(double u, double v, const point3& p) const override {
+        color value(double u, double v, const point3& p) const {
             return albedo;
         }
     
@@ -30,15 +42,16 @@ class solid_color : public texture {
 class checker_texture : public texture {
     public:
         checker_texture(double scale, shared_ptr<texture> even, shared_ptr<texture> odd)
-         : inv_scale(1.0 / scale), even(even), odd(odd) {}
+         : texture(kind_type::checker), inv_scale(1.0 / scale), even(even), odd(odd) {}
 
         checker_texture(double scale, const color& c1, const color& c2)
-          : inv_scale(1.0 / scale),
+          : texture(kind_type::checker),
+            inv_scale(1.0 / scale),
             even(make_shared<solid_color>(c1)),
             odd(make_shared<solid_color>(c2))
         {}
 
-        color value(double u, double v, const point3& p) const override {
+        color value(double u, double v, const point3& p) const {
             auto xInteger = int(std::floor(inv_scale * p.x()));
             auto yInteger = int(std::floor(inv_scale * p.y()));
             auto zInteger = int(std::floor(inv_scale * p.z()));
@@ -56,9 +69,9 @@ class checker_texture : public texture {
 
 class image_texture : public texture {
     public:
-        image_texture(const char* filename) : image(filename) {}
+        image_texture(const char* filename) : texture(kind_type::image), image(filename) {}
 
-        color value(double u, double v, const point3& p) const override {
+        color value(double u, double v, const point3& p) const {
             // No IMG -> return cyan
             if(image.height() <= 0) return color(0,1,1);
 
@@ -80,11 +93,11 @@ class image_texture : public texture {
 
 class noise_texture : public texture {
     public:
-        noise_texture() {}
+        noise_texture() : texture(kind_type::noise) {}
 
-        noise_texture(double scale) : scale(scale) {}
+        noise_texture(double scale) : texture(kind_type::noise), scale(scale) {}
 
-        color value(double u, double v, const point3& p) const override {
+        color value(double u, double v, const point3& p) const {
             return color(0.5, 0.5, 0.5) * (1 + sin(scale * p.z() + 10 * noise.turb(p, 7)));
         }
 
@@ -93,4 +106,14 @@ class noise_texture : public texture {
         double scale;
 };
 
+inline color texture::value(double u, double v, const point3& p) const {
+    switch(type) {
+        case kind_type::solid_color: return static_cast<const solid_color*>(this)->value(u, v, p);
+        case kind_type::checker:     return static_cast<const checker_texture*>(this)->value(u, v, p);
+        case kind_type::image:       return static_cast<const image_texture*>(this)->value(u, v, p);
+        case kind_type::noise:       return static_cast<const noise_texture*>(this)->value(u, v, p);
+    }
+    return color(1,0,1); // Unknown kind: magenta, like missing image data
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,276 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../Helper/rtweekend.h"
+
+// Image Output
+// Writers encode the linear radiance framebuffer (rgb doubles, top row first) into bytes, as a
+// header, bands of rows and a trailer. encode() does a whole image in parallel bands into one
+// packed buffer that write() stores with a single call, image_stream writes bands as they finish.
+class image_writer {
+    public:
+        enum file_format {automatic, ppm_ascii, ppm, pfm, qoi};
+
+        virtual ~image_writer() = default;
+
+        virtual std::string header(int width, int height) const = 0;
+
+        // Appends rows [y0, y1) to out, rows[0] is the first pixel of row y0. 'before' is the
+        // pixel preceding row y0 in the image (nullptr for y0 = 0), used by predictive formats.
+        virtual void encode_rows(const double* rows, int width, int y0, int y1, const double* before,
+                                 std::vector<uint8_t>& out) const = 0;
+
+        virtual std::string trailer() const {return "";}
+
+        // Rows are stored last to first (PFM), requires the same encoded size for every row
+        virtual bool bottom_up() const {return false;}
+
+        std::vector<uint8_t> encode(const double* radiance, int width, int height, int threads) const {
+            threads = std::max(1, std::min(threads, height));
+            std::vector<std::vector<uint8_t>> bands(threads);
+            parallel_rows(height, threads, [&](int band, int y0, int y1) {
+                const double* before = y0 > 0 ? radiance + (size_t(y0) * width - 1) * 3 : nullptr;
+                encode_rows(radiance + size_t(y0) * width * 3, width, y0, y1, before, bands[band]);
+            });
+            if(bottom_up())
+                std::reverse(bands.begin(), bands.end());
+
+            std::string head = header(width, height), tail = trailer();
+            size_t size = head.size() + tail.size();
+            for(auto& band : bands)
+                size += band.size();
+
+            std::vector<uint8_t> out;
+            out.reserve(size);
+            out.insert(out.end(), head.begin(), head.end());
+            for(auto& band : bands)
+                out.insert(out.end(), band.begin(), band.end());
+            out.insert(out.end(), tail.begin(), tail.end());
+            return out;
+        }
+
+        bool write(const std::string& path, const double* radiance, int width, int height, int threads = 1) const {
+            auto bytes = encode(radiance, width, height, threads);
+            std::ofstream file(path, std::ios::binary);
+            file.write(reinterpret_cast<const char*>(bytes.data()), std::streamsize(bytes.size()));
+            return bool(file);
+        }
+
+        static file_format from_name(const std::string& name) {
+            // Picks the format from the file extension, binary PPM unless .pfm or .qoi
+            auto ends_with = [&](const char* ext) {
+                size_t n = strlen(ext);
+                return name.size() >= n && name.compare(name.size() - n, n, ext) == 0;
+            };
+            if(ends_with(".pfm")) return pfm;
+            if(ends_with(".qoi")) return qoi;
+            return ppm;
+        }
+
+    protected:
+        template <typename F>
+        static void parallel_rows(int height, int threads, F&& rows) {
+            // Calls rows(band, y0, y1) on contiguous bands of rows, one band per thread
+            threads = std::max(1, std::min(threads, height));
+            std::vector<std::thread> t;
+            for(int k = 1; k < threads; k++)
+                t.emplace_back([&, k] {rows(k, height * k / threads, height * (k+1) / threads);});
+            rows(0, 0, height / threads);
+            for(auto& worker : t)
+                worker.join();
+        }
+
+        static std::string pnm_header(const char* magic, int width, int height, const char* max_value) {
+            return std::string(magic) + '\n' + std::to_string(width) + ' ' + std::to_string(height) + '\n' + max_value + '\n';
+        }
+};
+
+// Plain text P3, the original output format
+class ppm_ascii_writer : public image_writer {
+    public:
+        std::string header(int width, int height) const override {return pnm_header("P3", width, height, "255");}
+
+        void encode_rows(const double* rows, int width, int y0, int y1, const double*, std::vector<uint8_t>& out) const override {
+            std::string text;
+            for(size_t i = 0; i < size_t(y1 - y0) * width * 3; i++) {
+                text += std::to_string(to_byte(rows[i]));
+                text += i % 3 < 2 ? ' ' : '\n';
+            }
+            out.insert(out.end(), text.begin(), text.end());
+        }
+};
+
+// Binary P6
+class ppm_writer : public image_writer {
+    public:
+        std::string header(int width, int height) const override {return pnm_header("P6", width, height, "255");}
+
+        void encode_rows(const double* rows, int width, int y0, int y1, const double*, std::vector<uint8_t>& out) const override {
+            // Gamma 2 and clamp to bytes
+            size_t n = size_t(y1 - y0) * width * 3;
+            size_t offset = out.size();
+            out.resize(offset + n);
+            for(size_t i = 0; i < n; i++)
+                out[offset + i] = to_byte(rows[i]);
+        }
+};
+
+// Portable float map: unclamped linear radiance, little-endian, rows stored bottom to top
+class pfm_writer : public image_writer {
+    public:
+        std::string header(int width, int height) const override {return pnm_header("PF", width, height, "-1.0");}
+
+        bool bottom_up() const override {return true;}
+
+        void encode_rows(const double* rows, int width, int y0, int y1, const double*, std::vector<uint8_t>& out) const override {
+            size_t row_floats = size_t(width) * 3;
+            size_t offset = out.size();
+            out.resize(offset + row_floats * (y1 - y0) * sizeof(float));
+            uint8_t* dst = out.data() + offset;
+            for(int y = y1 - 1; y >= y0; y--) {
+                for(size_t i = 0; i < row_floats; i++) {
+                    float value = float(rows[(y - y0) * row_floats + i]);
+                    memcpy(dst, &value, sizeof(float)); // Assumes a little-endian host
+                    dst += sizeof(float);
+                }
+            }
+        }
+};
+
+// "Quite OK Image" format (qoiformat.org), lossless and fast to encode. Bands of rows are
+// encoded independently: a band starts from the pixel before it as its 'previous' pixel and with
+// an empty index, which a sequential decoder reads back identically.
+class qoi_writer : public image_writer {
+    public:
+        std::string header(int width, int height) const override {
+            std::string head = "qoif";
+            for(uint32_t v : {uint32_t(width), uint32_t(height)})
+                for(int shift = 24; shift >= 0; shift -= 8)
+                    head += char(uint8_t(v >> shift));
+            head += char(3); // RGB
+            head += char(0); // sRGB with linear alpha
+            return head;
+        }
+
+        std::string trailer() const override {return std::string(7, '\0') + char(1);}
+
+        void encode_rows(const double* rows, int width, int y0, int y1, const double* before, std::vector<uint8_t>& out) const override {
+            pixel prev = {0, 0, 0, 255};
+            if(before)
+                prev = {to_byte(before[0]), to_byte(before[1]), to_byte(before[2]), 255};
+            size_t count = size_t(y1 - y0) * width;
+            out.reserve(out.size() + count * 2);
+            encode_pixels(rows, count, prev, out);
+        }
+
+    private:
+        struct pixel {
+            uint8_t r, g, b, a;
+            bool operator==(const pixel& o) const {return r == o.r && g == o.g && b == o.b && a == o.a;}
+        };
+
+        static void encode_pixels(const double* rows, size_t count, pixel prev, std::vector<uint8_t>& out) {
+            pixel index[64] = {};
+            int run = 0;
+            for(size_t i = 0; i < count; i++) {
+                pixel px = {to_byte(rows[i*3]), to_byte(rows[i*3 + 1]), to_byte(rows[i*3 + 2]), 255};
+                if(px == prev) {
+                    if(++run == 62) {
+                        out.push_back(uint8_t(0xc0 | (run - 1))); // QOI_OP_RUN
+                        run = 0;
+                    }
+                    continue;
+                }
+                if(run > 0) {
+                    out.push_back(uint8_t(0xc0 | (run - 1)));
+                    run = 0;
+                }
+
+                int hash = (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64;
+                if(index[hash] == px) {
+                    out.push_back(uint8_t(hash)); // QOI_OP_INDEX
+                } else {
+                    index[hash] = px;
+                    int dr = int8_t(px.r - prev.r);
+                    int dg = int8_t(px.g - prev.g);
+                    int db = int8_t(px.b - prev.b);
+                    int dr_dg = dr - dg, db_dg = db - dg;
+                    if(dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2) {
+                        out.push_back(uint8_t(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2))); // QOI_OP_DIFF
+                    } else if(dg > -33 && dg < 32 && dr_dg > -9 && dr_dg < 8 && db_dg > -9 && db_dg < 8) {
+                        out.push_back(uint8_t(0x80 | (dg + 32)));                                 // QOI_OP_LUMA
+                        out.push_back(uint8_t((dr_dg + 8) << 4 | (db_dg + 8)));
+                    } else {
+                        out.push_back(0xfe);                                                      // QOI_OP_RGB
+                        out.push_back(px.r);
+                        out.push_back(px.g);
+                        out.push_back(px.b);
+                    }
+                }
+                prev = px;
+            }
+            if(run > 0)
+                out.push_back(uint8_t(0xc0 | (run - 1)));
+        }
+};
+
+inline shared_ptr<image_writer> make_image_writer(image_writer::file_format format, const std::string& name = "") {
+    if(format == image_writer::automatic)
+        format = image_writer::from_name(name);
+    switch(format) {
+        case image_writer::ppm_ascii: return make_shared<ppm_ascii_writer>();
+        case image_writer::pfm:       return make_shared<pfm_writer>();
+        case image_writer::qoi:       return make_shared<qoi_writer>();
+        default:                      return make_shared<ppm_writer>();
+    }
+}
+
+// Writes an image band by band, in order from the top, without the whole image in memory.
+// Bottom-up formats seek to each band's place in the file.
+class image_stream {
+    public:
+        image_stream(shared_ptr<image_writer> writer, const std::string& path, int width, int height)
+         : writer(writer), file(path, std::ios::binary), width(width), height(height) {
+            std::string head = writer->header(width, height);
+            file.write(head.data(), std::streamsize(head.size()));
+            header_size = head.size();
+        }
+
+        void write_rows(const double* rows, int y0, int y1) {
+            // rows[0] is the first pixel of row y0, y0 must be where the previous band ended
+            bytes.clear();
+            writer->encode_rows(rows, width, y0, y1, y0 > 0 ? last : nullptr, bytes);
+            if(writer->bottom_up())
+                file.seekp(std::streamoff(header_size + bytes.size() / (y1 - y0) * (height - y1)));
+            file.write(reinterpret_cast<const char*>(bytes.data()), std::streamsize(bytes.size()));
+
+            const double* back = rows + (size_t(y1 - y0) * width - 1) * 3;
+            std::copy(back, back + 3, last);
+        }
+
+        bool close() {
+            std::string tail = writer->trailer();
+            file.seekp(0, std::ios::end);
+            file.write(tail.data(), std::streamsize(tail.size()));
+            file.close();
+            return !file.fail();
+        }
+
+    private:
+        shared_ptr<image_writer> writer;
+        std::ofstream file;
+        int width, height;
+        size_t header_size;
+        std::vector<uint8_t> bytes;
+        double last[3]; // Last pixel written, 'before' of the next band
+};
+
+#endif
@@ -4,14 +4,25 @@
 #include <string>
 #include <stdio.h>
 #include <mutex>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <filesystem>
+#include <vector>
 
 #include "Helper/rtweekend.h"
+#include "Helper/alloc_counter.h"
+#include "Helper/checkpoint.h"
 //#include "External/glfw3.h"
 
 #include "Hittable/hittable.h"
+#include "Bounding_Volume_Hierarchies/bvh.h"
 #include "Materials/material.h"
 #include "Helper/pdf.h"
 #include "Post-processing/filter.h"
+#include "Post-processing/image_writer.h"
 
 class camera {
     public:
@@ -32,28 +43,134 @@ class camera {
     double defocus_angle = 0;
     double focus_dist = 10;
 
+    // Rendering mode: ambient occlusion (white where nothing lies within ao_distance along a
+    // cosine-weighted direction), direct light through one shadow ray per hit, or full global
+    // illumination. reflectionsOnly is not implemented yet, render() refuses it.
     enum rayTracingType {ambientOcclusion, shadowRays, reflectionsOnly, globalIllumination};
+    rayTracingType mode = globalIllumination;
+    double ao_distance = 100; // Reach of the occlusion rays, about a fifth of the scene size
+
+    // Integrator
+    enum integratorType {recursive, iterative};
+    // Iterative carries the path throughput in a loop. It has no counterpart of the recursive
+    // integrator's per-bounce clamp, so it converges to a brighter image where the clamp is active.
+    integratorType integrator = recursive;
+    int rr_min_depth = 5; // Russian roulette from this bounce on (iterative only), >= max_depth disables it
+
+    // Adaptive Sampling: pixels take stratified batches of samples until the 95% confidence interval
+    // of their mean, after gamma, is narrower than adaptive_tolerance, or max_samples_per_pixel is reached.
+    // samples_per_pixel is ignored in this mode.
+    bool   adaptive              = false;
+    int    adaptive_batch        = 16;   // Samples per batch (rounded down to a square, at least 4)
+    int    max_samples_per_pixel = 1024;
+    double adaptive_tolerance    = 0.05; // Width of the interval in display units [0,1]
+    std::string samples_output   = "";   // Debug: heatmap of samples spent per pixel, "" disables
+
+    // Random sequence of the render, every pixel sample is seeded from (seed, pixel, sample)
+    uint64_t seed = 0;
+
+    // Work Distribution
+    int  tile_size    = 16;   // Tile edge length in pixels, 0 falls back to interleaved scanlines
+    int  packet_size  = 4;    // Primary rays traced as packet_size^2 pixel packets (max 8) if defocus_angle <= 0, 0 disables
+    bool thread_stats = true; // Report busy and idle time per thread after rendering
+
+    // Wavefront Engine: the samples of a tile are traced in batches of up to wavefront_size paths,
+    // one stage at a time for the whole batch: generate camera rays, extend (closest hits), shade
+    // (grouped by material type) and shadow-test. Every path keeps its own random sequence and the
+    // estimators are shared with the path-at-a-time loops, so the image is the same.
+    // Needs tiles, and is not used with adaptive sampling or the recursive integrator.
+    bool wavefront         = false;
+    int  wavefront_size    = 4096;  // Paths per batch
+    bool wavefront_sort    = true;  // Shade the hits grouped by material type
+    bool wavefront_reorder = false; // Trace bounce and shadow rays ordered by direction octant and origin
 
     std::string output = "render.ppm";
+    image_writer::file_format format = image_writer::automatic; // By extension: .pfm, .qoi, else binary PPM
+
+    // Streaming Output: bands of tile_size rows are written as soon as all their tiles are done, so
+    // memory is bounded by the bands in flight instead of the image size. No denoising in this mode.
+    bool streaming = false;
+    int  max_bands_in_flight = 0; // Bands being rendered or waiting for their turn, 0 for 2 * threads
+
+    // Checkpoints: the finished tiles are saved every checkpoint_interval seconds, and on SIGINT or
+    // SIGTERM, which also stop the render once the tiles in progress are done. Rendering again with
+    // the same settings resumes from the file and gives the same image as an uninterrupted run.
+    // The file is removed when the render completes. Not available with streaming.
+    std::string checkpoint = "";       // File in ../Rendered_Images, "" disables
+    double checkpoint_interval = 300;  // Seconds
     
     void render(const hittable& world, const hittable& lights, int threads = 1, bool denoise = false) {
+        if(mode == reflectionsOnly) {
+            std::cerr << "Rendering mode reflectionsOnly is not implemented, nothing rendered\n";
+            return;
+        }
         initialize();
 
-        double* img = (double*) malloc(sizeof(double)*image_width*image_height*3);
+        // Without lights there is nothing to mix with the material's pdf. An empty light list
+        // still answers pdf_value() with a random number, which gives the unclamped iterative
+        // integrator unbounded variance and the recursive one needless noise.
+        sample_lights = !lights.bounding_box().is_empty();
+
+        threads = (threads<1) ? 1 : threads;
+        stats = std::vector<worker_stats>(threads);
+
+        // Linear radiance, tone mapped by the image writer. Streaming only keeps the bands in flight.
+        std::vector<double> framebuffer(streaming ? 0 : size_t(image_width) * image_height * 3);
+        double* img = framebuffer.data();
         double* dNois;
+        if(streaming)
+            begin_stream(threads);
+        auto begin = std::chrono::steady_clock::now();
+
         // Divide the Work
-        if(threads == 1) {
-            drawPixels(world, lights, img);
-        } else {
-            thread *t = (thread *) malloc(threads*sizeof(thread *));
-            for(int i = 0; i < threads; i++) {
+        bool interrupted = false;
+        if(tile_size > 0) {
+            build_tiles();
+            if(checkpointing)
+                load_checkpoint(img);
+            queue_tiles(threads);
+
+            std::thread saver;
+            if(checkpointing)
+                saver = start_checkpoints(img);
+            std::vector<thread> t;
+            for(int i = 1; i < threads; i++) {
                 std::clog << "Starting Thread " << i << ":\n";
-                t[i] = thread(&camera::drawPixels, this, std::cref(world), std::cref(lights), std::ref(img), i, threads);
+                t.emplace_back(&camera::drawTiles, this, std::cref(world), std::cref(lights), img, i);
             }
+            drawTiles(world, lights, img, 0);
+            for(auto& worker : t)
+                worker.join();
+            if(checkpointing)
+                interrupted = stop_checkpoints(saver, img);
+        } else if(threads == 1) {
+            drawPixels(world, lights, img, 0);
+        } else {
+            std::vector<thread> t;
             for(int i = 0; i < threads; i++) {
-                t[i].join();
+                std::clog << "Starting Thread " << i << ":\n";
+                t.emplace_back(&camera::drawPixels, this, std::cref(world), std::cref(lights), img, i, threads);
             }
-            free(t);
+            for(auto& worker : t)
+                worker.join();
+        }
+
+        std::chrono::duration<double> wall = std::chrono::steady_clock::now() - begin;
+        if(thread_stats)
+            print_thread_stats(wall.count());
+        if(interrupted)
+            return;
+        if(adaptive)
+            write_samples_map();
+
+        if(streaming) {
+            if(!stream->close())
+                std::cerr << "Could not write ../Rendered_Images/" << output << '\n';
+            stream = nullptr;
+            std::clog << "Streamed output, at most " << bands_peak << " bands ("
+                      << bands_peak * tile_size * image_width * 3 * sizeof(double) / 1024 << " KiB) in memory\n";
+            std::clog << "\rDone. \n";
+            return;
         }
 
         //Post Processing:
@@ -66,24 +183,26 @@ class camera {
             dNois = img;
         }
 
-        // Output File        
-        ofstream renderedFile;
-        renderedFile.open("../Rendered_Images/"+output);
-        
+        // Output File
         std::clog << "Writing output file...\n";
-        renderedFile << "P3\n" << image_width << ' ' << image_height << "\n255\n";
-        for(int i = 0; i < image_height; i++) {
-            int row = i*image_width*3;
-            for(int j = 0; j < image_width; j++) {
-                int col = j*3;
-                renderedFile << dNois[row + col] << ' ' << dNois[row + col + 1] << ' ' << dNois[row + col + 2] << '\n';
-            }
-        }
-        
-        std::clog << "\rDone. \n";
+        auto write_begin = std::chrono::steady_clock::now();
+        auto writer = make_image_writer(format, output);
+        if(!writer->write("../Rendered_Images/"+output, dNois, image_width, image_height, threads))
+            std::cerr << "Could not write ../Rendered_Images/" << output << '\n';
+        std::chrono::duration<double> write_time = std::chrono::steady_clock::now() - write_begin;
+
+        std::clog << "\rDone. (output written in " << write_time.count() << "s)\n";
         return;
     }
 
+    uint64_t traced_rays() const {
+        // Camera rays, bounces and shadow rays of all threads in the last render()
+        uint64_t rays = 0;
+        for(const auto& st : stats)
+            rays += st.rays;
+        return rays;
+    }
+
     private:
     int     image_height;
     double  pixel_samples_scale;
@@ -97,15 +216,77 @@ class camera {
     vec3    defocus_disk_u;
     vec3    defocus_disk_v;
 
+    bool    sample_lights;          // Light list is not empty
+    bool    checkpointing;          // checkpoint is set and the render uses tiles
+
     std::mutex counterLock;
     std::mutex finishLock;
     int counter = 0;
 
+    // Image tile [x0, x1) x [y0, y1)
+    struct tile {
+        int x0, y0, x1, y1;
+    };
+
+    // Contiguous run of tiles owned by one worker. The owner and thieves both claim
+    // from the front with fetch_add, so no lock is needed. Padded to its own cache line.
+    struct alignas(64) tile_queue {
+        std::atomic<int> next{0};
+        int end = 0;
+    };
+
+    struct alignas(64) worker_stats {
+        double   busy = 0;
+        int      tiles = 0;
+        int      stolen = 0;
+        uint64_t rays = 0;
+        uint64_t nodes = 0;
+        uint64_t allocs = 0;
+    };
+
+    std::vector<tile> tiles;
+    std::vector<int> pending;       // Tiles left to render, the queues index into it
+    std::vector<tile_queue> queues;
+    std::vector<worker_stats> stats;
+    std::vector<int> samples_taken; // Per pixel, adaptive mode only
+
+    // Streaming state: a band's buffer lives from its first tile until the band has been written
+    struct band_buffer {
+        std::vector<double> pixels;
+        int tiles_left = 0;
+    };
+
+    std::vector<band_buffer> bands;
+    shared_ptr<image_stream> stream;
+    int bands_written = 0;
+    int band_limit = 0;
+    int bands_alive = 0;
+    int bands_peak = 0;
+    std::mutex streamLock;
+    std::mutex writerLock; // Held while bands are written, see finish_band_tile()
+    std::condition_variable band_written;
+
+    // Checkpoint state: workers publish finished tiles through tile_done, the checkpoint thread
+    // only reads tiles that are done, so it never has to lock out the workers
+    std::vector<std::atomic<bool>> tile_done;
+    std::atomic<bool> stop_tiles{false};
+    std::mutex checkpointLock;
+    std::condition_variable checkpoint_wake;
+    bool checkpoint_exit = false;
+    inline static volatile std::sig_atomic_t signal_received = 0;
+    void (*previous_sigint)(int) = SIG_DFL;
+    void (*previous_sigterm)(int) = SIG_DFL;
+
     void initialize() {
         image_height = int(image_width / aspect_ratio);
         image_height = (image_height<1) ? 1 : image_height;
 
         sqrt_spp = int(sqrt(samples_per_pixel));
+        if(adaptive) {
+            // Strata of one batch, the variance estimate needs at least two samples
+            sqrt_spp = std::max(2, int(sqrt(adaptive_batch)));
+            samples_taken.assign(size_t(image_width) * image_height, 0);
+        }
         pixel_samples_scale = 1.0 / (sqrt_spp * sqrt_spp);
         recip_sqrt_spp = 1.0 / sqrt_spp;
 
@@ -142,6 +323,16 @@ class camera {
         // Process Line Counter
         counter = image_height;
 
+        // Streaming and checkpoints work on tiles
+        checkpointing = !checkpoint.empty() && !streaming;
+        if(!checkpoint.empty() && streaming)
+            std::clog << "Checkpoints are not supported with streaming output, rendering without\n";
+        if((streaming || checkpointing) && tile_size <= 0)
+            tile_size = 16;
+
+        // Packets hold at most ray_packet::max_size rays
+        packet_size = std::min(packet_size, 8);
+
         // If not set, initialize backgroundTex to solid_color
         if(backgroundTex == nullptr)
             backgroundTex = make_shared<solid_color>(color());
@@ -180,25 +371,116 @@ class camera {
         return center + (p[0] * defocus_disk_u) + (p[1] * defocus_disk_v);
     }
 
+    static uint64_t& rays_traced() {
+        // Per-thread ray counter, read by the workers after each tile or scanline
+        thread_local uint64_t count = 0;
+        return count;
+    }
+
     // Path Tracing, brings Global Illumination
     color ray_color(const ray& r, int depth, const hittable& world, const hittable& lights) const {
         if (depth <= 0)
             return color(0,0,0);
         
         hit_record rec;
+        rays_traced()++;
 
         // hit function is Ray-Triangle Intersection Test, possibly HW accellerated
-        if(!world.hit(r, interval(0.001, infinity), rec)) {
-            double u, v;
-            vec3 p = unit_vector(r.direction());
-            auto theta = acos(-p.y());
-            auto phi = atan2(-p.z(), p.x()) + pi;
+        if(!world.hit(r, interval(0, infinity), rec))
+            return background(r);
+        rec.finalize(r);
 
-            u = phi / (2*pi);
-            v = theta / pi;
-            return backgroundTex->value(u,v,p);
+        return shade(r, rec, depth, world, lights);
+    }
+
+    // Iterative Path Tracing: same estimator as ray_color/shade, but one loop iteration per bounce.
+    // Contributions are weighted by the path throughput instead of being returned up the stack,
+    // so shade()'s per-bounce clamp of the scattered light has no counterpart here.
+    // 'first' optionally supplies the hit of the primary ray (packet tracing).
+    color trace_path(ray r, const hittable& world, const hittable& lights, const hit_record* first = nullptr) const {
+        color radiance(0,0,0);
+        color throughput(1,1,1);
+
+        for(int depth = 0; depth < max_depth; depth++) {
+            hit_record rec;
+            if(depth == 0 && first) {
+                rec = *first;
+            } else {
+                rays_traced()++;
+                if(!world.hit(r, interval(0, infinity), rec)) {
+                    radiance += throughput * background(r);
+                    break;
+                }
+                rec.finalize(r);
+            }
+
+            if(!scatter_path(r, rec, depth, lights, throughput, radiance))
+                break;
         }
+        return radiance;
+    }
+
+    // One bounce of the iterative estimator at the hit 'rec' of r: adds the emission to radiance,
+    // then replaces r by the scattered ray and updates throughput. False ends the path.
+    bool scatter_path(ray& r, const hit_record& rec, int depth, const hittable& lights, color& throughput, color& radiance) const {
+        scatter_record srec;
+        radiance += throughput * rec.mat->emitted(r, rec, rec.u, rec.v, rec.p);
+
+        if(!rec.mat->scatter(r, rec, srec))
+            return false;
+
+        if(srec.skip_pdf) {
+            // Specular reflection, no PDF
+            throughput = throughput * srec.attenuation;
+            r = spawn_ray(rec, srec.skip_pdf_ray.direction(), srec.skip_pdf_ray.time());
+        } else {
+            hittable_pdf light_pdf(lights, rec.p);
+            mixture_pdf mixture(light_pdf, *srec.pdf_ptr);
+            const pdf& p = sample_lights ? static_cast<const pdf&>(mixture) : *srec.pdf_ptr;
+
+            ray scattered = spawn_ray(rec, p.generate(), r.time());
+            auto pdf_val = p.value(scattered.direction());
+
+            double scattering_pdf = rec.mat->scattering_pdf(r, rec, scattered);
+
+            // Drop the path on NaN, negative or infinite weights, like shade() does
+            auto weight = scattering_pdf / pdf_val;
+            if(!(weight >= 0 && weight < infinity))
+                return false;
+
+            throughput = throughput * srec.attenuation * weight;
+            r = scattered;
+        }
+
+        // Russian roulette: continue with probability of the throughput, reweight survivors
+        if(depth + 1 >= rr_min_depth) {
+            double survive = fmin(fmax(throughput.x(), fmax(throughput.y(), throughput.z())), 1.0);
+            if(random_double() >= survive)
+                return false;
+            throughput /= survive;
+        }
+        return true;
+    }
+
+    color background(const ray& r) const {
+        double u, v;
+        vec3 p = unit_vector(r.direction());
+        auto theta = acos(-p.y());
+        auto phi = atan2(-p.z(), p.x()) + pi;
+
+        u = phi / (2*pi);
+        v = theta / pi;
+        return backgroundTex->value(u,v,p);
+    }
+
+    static ray spawn_ray(const hit_record& rec, const vec3& direction, double time) {
+        // Secondary rays start just off the surface on the side they leave on, so the
+        // hit test can use t_min = 0 instead of a scene-scale dependent epsilon
+        auto n = dot(direction, rec.normal) < 0 ? -rec.normal : rec.normal;
+        return ray(offset_ray_origin(rec.p, n), direction, time);
+    }
 
+    color shade(const ray& r, const hit_record& rec, int depth, const hittable& world, const hittable& lights) const {
         // Ray Bouncing
         scatter_record srec;
         color color_from_emission = rec.mat->emitted(r, rec, rec.u, rec.v, rec.p);
@@ -208,13 +490,15 @@ class camera {
 
         // Specular reflection, no PDF
         if(srec.skip_pdf) {
-            return srec.attenuation * ray_color(srec.skip_pdf_ray, depth - 1, world, lights);
+            auto skip_ray = spawn_ray(rec, srec.skip_pdf_ray.direction(), srec.skip_pdf_ray.time());
+            return srec.attenuation * ray_color(skip_ray, depth - 1, world, lights);
         }
 
-        auto light_ptr = make_shared<hittable_pdf>(lights, rec.p);
-        mixture_pdf p(light_ptr, srec.pdf_ptr);
+        hittable_pdf light_pdf(lights, rec.p);
+        mixture_pdf mixture(light_pdf, *srec.pdf_ptr);
+        const pdf& p = sample_lights ? static_cast<const pdf&>(mixture) : *srec.pdf_ptr;
 
-        ray scattered = ray(rec.p, p.generate(), r.time());
+        ray scattered = spawn_ray(rec, p.generate(), r.time());
         auto pdf_val = p.value(scattered.direction());
 
         double scattering_pdf = rec.mat->scattering_pdf(r, rec, scattered);
@@ -244,45 +528,938 @@ class camera {
 
     }
 
-    // TODO: Add Functions for Ambient Occlusion, Shadow Rays
+    // Ambient Occlusion: one cosine-weighted occlusion ray from the first hit
+    color ambient_occlusion(const ray& r, const hittable& world, const hit_record* first = nullptr) const {
+        hit_record rec;
+        if(first) {
+            rec = *first;
+        } else {
+            rays_traced()++;
+            if(!world.hit(r, interval(0, infinity), rec))
+                return background(r);
+            rec.finalize(r);
+        }
 
-    void drawPixels(const hittable& world, const hittable& lights, double* array, int curr = 1, int threads = 1) {
-        if(threads != 1) {
-            for(int j = curr; j < image_height; j+= threads) {
-                for(int i = 0; i < image_width; i++) {
-                    color pixel_color(0,0,0);
-                    for(int s_j = 0; s_j < sqrt_spp; s_j++) {
-                        for(int s_i = 0; s_i < sqrt_spp; s_i++) {
-                            ray r = get_ray(i, j, s_i, s_j);
-                            pixel_color += ray_color(r, max_depth, world, lights);
-                        }
+        ray probe = ao_probe(r, rec);
+        rays_traced()++;
+        return world.occluded(probe, interval(0, ao_distance)) ? color(0,0,0) : color(1,1,1);
+    }
+
+    ray ao_probe(const ray& r, const hit_record& rec) const {
+        onb uvw;
+        uvw.build_from_w(rec.normal);
+        return spawn_ray(rec, uvw.local(random_cosine_direction()), r.time());
+    }
+
+    // Direct Light: emission plus one light sample per hit, seen through a shadow ray.
+    // Specular surfaces pass the ray on. Radiance comes from the materials of the light list.
+    color direct_light(ray r, const hittable& world, const hittable& lights, const hit_record* first = nullptr) const {
+        color throughput(1,1,1);
+
+        for(int depth = 0; depth < max_depth; depth++) {
+            hit_record rec;
+            if(depth == 0 && first) {
+                rec = *first;
+            } else {
+                rays_traced()++;
+                if(!world.hit(r, interval(0, infinity), rec))
+                    return throughput * background(r);
+                rec.finalize(r);
+            }
+
+            color radiance, light;
+            double t_max;
+            switch(direct_step(r, rec, lights, throughput, radiance, t_max, light)) {
+                case path_bounce:
+                    continue;
+                case path_shadow:
+                    rays_traced()++;
+                    if(!world.occluded(r, interval(0, t_max)))
+                        radiance += light;
+                    break;
+                default:
+                    break;
+            }
+            return throughput * radiance;
+        }
+        return color(0,0,0);
+    }
+
+    // What a hit asks for next: nothing (the path is done), the next bounce along r, or the
+    // shadow test of r up to t_max
+    enum path_step {path_done, path_bounce, path_shadow};
+
+    // Direct light at the hit 'rec' of r. Specular surfaces pass the path on, r becomes the
+    // reflected ray. Otherwise radiance is set to the emission and, if a light was sampled, r to
+    // the shadow ray towards it: 'light' adds to radiance if nothing blocks r before t_max.
+    path_step direct_step(ray& r, const hit_record& rec, const hittable& lights, color& throughput,
+                          color& radiance, double& t_max, color& light) const {
+        scatter_record srec;
+        color emitted = rec.mat->emitted(r, rec, rec.u, rec.v, rec.p);
+        if(!rec.mat->scatter(r, rec, srec)) {
+            radiance = emitted;
+            return path_done;
+        }
+
+        if(srec.skip_pdf) {
+            throughput = throughput * srec.attenuation;
+            r = spawn_ray(rec, srec.skip_pdf_ray.direction(), srec.skip_pdf_ray.time());
+            return path_bounce;
+        }
+
+        radiance = emitted;
+        ray shadow;
+        if(!sample_lights || !sample_light(r, rec, lights, shadow, t_max, light))
+            return path_done;
+        light = srec.attenuation * light;
+        r = shadow;
+        return path_shadow;
+    }
+
+    bool sample_light(const ray& r, const hit_record& rec, const hittable& lights, ray& shadow, double& t_max, color& light) const {
+        // Light point from the light list, its radiance from the list's own copy of the light.
+        // The shadow ray stops just short of it, 'light' is what it brings if nothing is in between.
+        shadow = spawn_ray(rec, lights.random(rec.p), r.time());
+        auto light_pdf = lights.pdf_value(rec.p, shadow.direction());
+        hit_record light_rec;
+        if(!(light_pdf > 0) || !lights.hit(shadow, interval(0, infinity), light_rec))
+            return false;
+        light_rec.finalize(shadow);
+        if(!light_rec.mat)
+            return false;
+
+        t_max = light_rec.t * (1 - 1e-4);
+        auto emitted = light_rec.mat->emitted(shadow, light_rec, light_rec.u, light_rec.v, light_rec.p);
+        light = emitted * rec.mat->scattering_pdf(r, rec, shadow) / light_pdf;
+        return true;
+    }
+
+    color sample_radiance(const ray& r, const hittable& world, const hittable& lights, const hit_record* first = nullptr) const {
+        // 'first' optionally supplies the hit of the primary ray (packet tracing)
+        switch(mode) {
+            case ambientOcclusion:   return ambient_occlusion(r, world, first);
+            case shadowRays:         return direct_light(r, world, lights, first);
+            case globalIllumination: break;
+            case reflectionsOnly:    return color(1,0,1); // Refused by render()
+        }
+        if(integrator == iterative)
+            return trace_path(r, world, lights, first);
+        return first ? shade(r, *first, max_depth, world, lights) : ray_color(r, max_depth, world, lights);
+    }
+
+    color sample_pixel(const hittable& world, const hittable& lights, int i, int j) const {
+        color pixel_color(0,0,0);
+        for(int s_j = 0; s_j < sqrt_spp; s_j++) {
+            for(int s_i = 0; s_i < sqrt_spp; s_i++) {
+                seed_sample(seed, uint64_t(j)*image_width + i, s_j*sqrt_spp + s_i);
+                ray r = get_ray(i, j, s_i, s_j);
+                pixel_color += sample_radiance(r, world, lights);
+            }
+        }
+        return pixel_samples_scale * pixel_color;
+    }
+
+    color sample_pixel_adaptive(const hittable& world, const hittable& lights, int i, int j, int& taken) const {
+        // Batches of sqrt_spp^2 stratified samples, the luminance of the samples gives the running
+        // mean and variance. Sample indices continue across batches, so every sample has its own seed.
+        color pixel_color(0,0,0);
+        double lum_sum = 0, lum_sq = 0;
+        int batch = sqrt_spp * sqrt_spp;
+        int n = 0;
+        do {
+            for(int s_j = 0; s_j < sqrt_spp; s_j++) {
+                for(int s_i = 0; s_i < sqrt_spp; s_i++) {
+                    seed_sample(seed, uint64_t(j)*image_width + i, n + s_j*sqrt_spp + s_i);
+                    ray r = get_ray(i, j, s_i, s_j);
+                    color c = sample_radiance(r, world, lights);
+                    double lum = (c.x() + c.y() + c.z()) / 3;
+                    pixel_color += c;
+                    lum_sum += lum;
+                    lum_sq += lum * lum;
+                }
+            }
+            n += batch;
+        } while(n + batch <= max_samples_per_pixel && !converged(lum_sum, lum_sq, n));
+
+        taken = n;
+        return pixel_color / n;
+    }
+
+    bool converged(double sum, double sum_sq, int n) const {
+        // 95% confidence interval of the mean, measured after clamping and gamma like the output.
+        // Dark pixels thus need a tighter interval than bright ones, saturated pixels stop at once.
+        double mean = sum / n;
+        double variance = fmax(0.0, (sum_sq - sum * mean) / (n - 1));
+        double half_width = 1.96 * sqrt(variance / n);
+
+        static const interval display(0, 1);
+        double lo = linear_to_gamma(display.clamp(mean - half_width));
+        double hi = linear_to_gamma(display.clamp(mean + half_width));
+        return hi - lo <= adaptive_tolerance;
+    }
+
+    void render_pixel(const hittable& world, const hittable& lights, double* array, int i, int j, int row0 = 0) {
+        // 'array' starts at image row row0
+        if(adaptive) {
+            int taken;
+            set_pixel(array, i, j - row0, sample_pixel_adaptive(world, lights, i, j, taken));
+            samples_taken[size_t(j)*image_width + i] = taken;
+        } else {
+            set_pixel(array, i, j - row0, sample_pixel(world, lights, i, j));
+        }
+    }
+
+    void set_pixel(double* array, int i, int j, const color& pixel_color) const {
+        // Framebuffer holds linear radiance, the image writer does the tone mapping
+        double* px = &array[(size_t(j)*image_width + i)*3];
+        px[0] = pixel_color.x();
+        px[1] = pixel_color.y();
+        px[2] = pixel_color.z();
+    }
+
+    void write_samples_map() const {
+        // Mean and max samples per pixel, plus an optional heatmap (blue: few, red: max_samples_per_pixel)
+        uint64_t total = 0;
+        int most = 0;
+        for(int n : samples_taken) {
+            total += n;
+            most = std::max(most, n);
+        }
+        std::clog << "Adaptive sampling: " << double(total) / samples_taken.size()
+                  << " samples per pixel on average, " << most << " at most\n";
+
+        if(samples_output.empty())
+            return;
+        std::vector<double> heatmap;
+        for(int n : samples_taken) {
+            double t = double(n) / max_samples_per_pixel;
+            // Squared, the writer's gamma turns it back into the ramp
+            for(double c : {t, 4 * t * (1 - t), 1 - t})
+                heatmap.push_back(c * c);
+        }
+        make_image_writer(image_writer::automatic, samples_output)
+            ->write("../Rendered_Images/" + samples_output, heatmap.data(), image_width, image_height);
+    }
+
+    void sample_packet(const hittable& world, const hittable& lights, int x0, int y0, int x1, int y1, color* pixel_color) const {
+        // Primary rays of all pixels in [x0, x1) x [y0, y1) for one sample index at a time. The
+        // packet only shares the first hit, every ray then continues on its own random sequence.
+        ray_packet packet;
+        int pixels = (x1 - x0) * (y1 - y0);
+        for(int k = 0; k < pixels; k++)
+            pixel_color[k] = color(0,0,0);
+
+        for(int s_j = 0; s_j < sqrt_spp; s_j++) {
+            for(int s_i = 0; s_i < sqrt_spp; s_i++) {
+                packet.size = 0;
+                for(int j = y0; j < y1; j++) {
+                    for(int i = x0; i < x1; i++) {
+                        seed_sample(seed, uint64_t(j)*image_width + i, s_j*sqrt_spp + s_i);
+                        ray r = get_ray(i, j, s_i, s_j);
+                        packet.add(r, thread_rng().position());
+                    }
+                }
+
+                world.hit_packet(packet, 0);
+
+                for(int k = 0; k < pixels; k++) {
+                    thread_rng().seed(packet.rng[k]);
+                    rays_traced()++;
+                    if(!packet.found[k]) {
+                        pixel_color[k] += background(packet.rays[k]);
+                    } else {
+                        packet.rec[k].finalize(packet.rays[k]);
+                        pixel_color[k] += sample_radiance(packet.rays[k], world, lights, &packet.rec[k]);
                     }
-                    write_color(&array[image_width*j*3 + i*3], pixel_samples_scale * pixel_color);
                 }
-                std::lock_guard<std::mutex> lock(counterLock);
-                std::clog << "\rScanlines remaining: " << --counter << '\n' << std::flush;
             }
+        }
+
+        for(int k = 0; k < pixels; k++)
+            pixel_color[k] *= pixel_samples_scale;
+    }
+
+    // Paths of a wavefront batch as structure of arrays, kept by a worker from tile to tile.
+    // A path's ray slot holds its next ray, or its shadow ray while it waits for the shadow test.
+    // Slots start in path order; reorder_rays() moves them around, 'path' remembers which is which.
+    struct wavefront_batch {
+        std::vector<point3>     origin;
+        std::vector<vec3>       direction;
+        std::vector<double>     time;
+        std::vector<uint64_t>   rng;        // thread_rng() position of each path
+        std::vector<color>      throughput;
+        std::vector<color>      radiance;
+        std::vector<hit_record> hits;
+        std::vector<double>     t_max;      // Shadow test: reach of the shadow ray
+        std::vector<color>      light;      // Shadow test: added to radiance if nothing blocks the ray
+        std::vector<int>        active;     // Paths to extend
+        std::vector<int>        shading;    // Paths with a hit, in shading order
+        std::vector<int>        sorted;     // Scratch for sorting 'shading'
+        std::vector<int>        shadowed;   // Paths waiting for their shadow test
+        std::vector<int>        path;       // Path number of each slot
+        std::vector<uint64_t>   keys;       // Reordering rays: sort key << 32 | slot
+        std::vector<uint64_t>   keys_scratch;
+        std::vector<int>        target;     // Reordering rays: new slot of each slot
+        std::vector<color>      pixel_sum;  // Per pixel of the tile
+        ray_packet              packet;     // Camera rays of neighbouring pixels
+        int                     count = 0;  // Slots in use
+
+        void resize(int paths) {
+            origin.resize(paths);
+            direction.resize(paths);
+            time.resize(paths);
+            rng.resize(paths);
+            throughput.resize(paths);
+            radiance.resize(paths);
+            hits.resize(paths);
+            t_max.resize(paths);
+            light.resize(paths);
+            path.resize(paths);
+        }
+
+        void swap_paths(int a, int b) {
+            // Hit records are not moved, they only live from extend_paths() to shade_paths()
+            std::swap(origin[a], origin[b]);
+            std::swap(direction[a], direction[b]);
+            std::swap(time[a], time[b]);
+            std::swap(rng[a], rng[b]);
+            std::swap(throughput[a], throughput[b]);
+            std::swap(radiance[a], radiance[b]);
+            std::swap(t_max[a], t_max[b]);
+            std::swap(light[a], light[b]);
+            std::swap(path[a], path[b]);
+        }
+
+        void permute() {
+            // Moves every slot to target[slot] in place, one swap per slot along each cycle
+            for(int a = 0; a < count; a++) {
+                while(target[a] != a) {
+                    int b = target[a];
+                    swap_paths(a, b);
+                    std::swap(target[a], target[b]);
+                }
+            }
+        }
+
+        ray get_ray(int k) const {return ray(origin[k], direction[k], time[k]);}
+
+        void set_ray(int k, const ray& r) {
+            origin[k] = r.origin();
+            direction[k] = r.direction();
+            time[k] = r.time();
+        }
+    };
+
+    bool use_wavefront() const {
+        return wavefront && !adaptive && (mode == ambientOcclusion || mode == shadowRays || integrator == iterative);
+    }
+
+    void render_wavefront(const hittable& world, const hittable& lights, const tile& tl, double* array, int row0,
+                          wavefront_batch& batch) const {
+        // Paths are numbered sample-major over the tile's pixels and added to their pixel in that
+        // order, so every pixel sums its samples in the same order as sample_pixel()
+        int width = tl.x1 - tl.x0;
+        int pixels = width * (tl.y1 - tl.y0);
+        int total = pixels * sqrt_spp * sqrt_spp;
+        int size = std::max(1, wavefront_size);
+        batch.resize(std::min(size, total));
+        batch.pixel_sum.assign(pixels, color(0,0,0));
+
+        for(int first = 0; first < total; first += size) {
+            int count = std::min(size, total - first);
+            generate_paths(batch, tl, first, count);
+            for(int depth = 0; !batch.active.empty(); depth++) {
+                extend_paths(world, batch, depth);
+                shade_paths(lights, batch, depth);
+                shadow_test_paths(world, batch);
+            }
+            if(wavefront_reorder) {
+                // Back into path order
+                batch.target.assign(batch.path.begin(), batch.path.begin() + count);
+                batch.permute();
+            }
+            for(int k = 0; k < count; k++)
+                batch.pixel_sum[(first + k) % pixels] += batch.radiance[k];
+        }
+
+        for(int p = 0; p < pixels; p++)
+            set_pixel(array, tl.x0 + p % width, tl.y0 + p / width - row0, pixel_samples_scale * batch.pixel_sum[p]);
+    }
+
+    void generate_paths(wavefront_batch& batch, const tile& tl, int first, int count) const {
+        int width = tl.x1 - tl.x0;
+        int pixels = width * (tl.y1 - tl.y0);
+        bool bounces = mode == ambientOcclusion || max_depth > 0;
+        batch.active.clear();
+        batch.count = count;
+        for(int k = 0; k < count; k++) {
+            int sample = (first + k) / pixels;
+            int pixel = (first + k) % pixels;
+            int i = tl.x0 + pixel % width;
+            int j = tl.y0 + pixel / width;
+            seed_sample(seed, uint64_t(j)*image_width + i, sample);
+            batch.set_ray(k, get_ray(i, j, sample % sqrt_spp, sample / sqrt_spp));
+            batch.rng[k] = thread_rng().position();
+            batch.throughput[k] = color(1,1,1);
+            batch.radiance[k] = color(0,0,0);
+            batch.path[k] = k;
+            if(bounces)
+                batch.active.push_back(k);
+        }
+    }
+
+    void extend_paths(const hittable& world, wavefront_batch& batch, int depth) const {
+        // Closest hits of all active paths, misses take the background and end. Camera rays follow
+        // each other pixel by pixel and are traced as packets under the same conditions as in
+        // drawTiles().
+        auto& rng = thread_rng();
+        batch.shading.clear();
+        if(depth == 0 && packet_size > 0 && defocus_angle <= 0) {
+            ray_packet& packet = batch.packet;
+            for(size_t first = 0; first < batch.active.size(); first += ray_packet::max_size) {
+                size_t end = std::min(first + ray_packet::max_size, batch.active.size());
+                packet.size = 0;
+                for(size_t n = first; n < end; n++)
+                    packet.add(batch.get_ray(batch.active[n]), batch.rng[batch.active[n]]);
+                world.hit_packet(packet, 0);
+
+                for(size_t n = first; n < end; n++) {
+                    int k = batch.active[n];
+                    int i = int(n - first);
+                    rays_traced()++;
+                    if(packet.found[i]) {
+                        batch.hits[k] = packet.rec[i];
+                        batch.hits[k].finalize(packet.rays[i]);
+                        batch.shading.push_back(k);
+                    } else {
+                        batch.radiance[k] += batch.throughput[k] * background(packet.rays[i]);
+                    }
+                    batch.rng[k] = packet.rng[i];
+                }
+            }
+        } else {
+            if(depth > 0 && wavefront_reorder)
+                reorder_rays(world.bounding_box(), batch, batch.active);
+            for(int k : batch.active) {
+                rng.seed(batch.rng[k]);
+                ray r = batch.get_ray(k);
+                hit_record& rec = batch.hits[k];
+                rec = hit_record();
+                rays_traced()++;
+                if(world.hit(r, interval(0, infinity), rec)) {
+                    rec.finalize(r);
+                    batch.shading.push_back(k);
+                } else {
+                    batch.radiance[k] += batch.throughput[k] * background(r);
+                }
+                batch.rng[k] = rng.position();
+            }
+        }
+
+        // Hits are shaded one material type after the other (counting sort, stable within a
+        // type), so each type's code runs on a long stretch of paths
+        if(wavefront_sort && mode != ambientOcclusion) {
+            int start[material::kind_count + 1] = {};
+            for(int k : batch.shading)
+                start[int(batch.hits[k].mat->kind()) + 1]++;
+            for(int m = 0; m < material::kind_count; m++)
+                start[m + 1] += start[m];
+            batch.sorted.resize(batch.shading.size());
+            for(int k : batch.shading)
+                batch.sorted[start[int(batch.hits[k].mat->kind())]++] = k;
+            std::swap(batch.shading, batch.sorted);
+        }
+    }
+
+    void shade_paths(const hittable& lights, wavefront_batch& batch, int depth) const {
+        // Bounces go back to the active list, light samples and occlusion probes to the shadow tests
+        auto& rng = thread_rng();
+        batch.active.clear();
+        batch.shadowed.clear();
+        bool last = depth + 1 >= max_depth;
+        for(int k : batch.shading) {
+            rng.seed(batch.rng[k]);
+            ray r = batch.get_ray(k);
+            const hit_record& rec = batch.hits[k];
+
+            if(mode == ambientOcclusion) {
+                batch.set_ray(k, ao_probe(r, rec));
+                batch.t_max[k] = ao_distance;
+                batch.light[k] = color(1,1,1);
+                batch.shadowed.push_back(k);
+            } else if(mode == shadowRays) {
+                switch(direct_step(r, rec, lights, batch.throughput[k], batch.radiance[k], batch.t_max[k], batch.light[k])) {
+                    case path_bounce:
+                        if(!last)
+                            batch.active.push_back(k);
+                        break;
+                    case path_shadow:
+                        batch.shadowed.push_back(k);
+                        break;
+                    default:
+                        batch.radiance[k] = batch.throughput[k] * batch.radiance[k];
+                        break;
+                }
+                batch.set_ray(k, r);
+            } else if(scatter_path(r, rec, depth, lights, batch.throughput[k], batch.radiance[k]) && !last) {
+                batch.set_ray(k, r);
+                batch.active.push_back(k);
+            }
+            batch.rng[k] = rng.position();
+        }
+    }
+
+    void shadow_test_paths(const hittable& world, wavefront_batch& batch) const {
+        auto& rng = thread_rng();
+        if(wavefront_reorder)
+            reorder_rays(world.bounding_box(), batch, batch.shadowed);
+        for(int k : batch.shadowed) {
+            rng.seed(batch.rng[k]);
+            rays_traced()++;
+            color radiance = batch.radiance[k];
+            if(!world.occluded(batch.get_ray(k), interval(0, batch.t_max[k])))
+                radiance += batch.light[k];
+            batch.radiance[k] = batch.throughput[k] * radiance;
+        }
+    }
+
+    void reorder_rays(const aabb& bounds, wavefront_batch& batch, std::vector<int>& paths) const {
+        // Bounce rays leave in all directions, so consecutive rays would walk unrelated parts of the
+        // BVH. Sorted by direction octant, then by the Morton code of their origin in the scene
+        // bounds, rays that start close together and head the same way are traced back to back.
+        // The paths move to their slots in that order, so the tracing loop also reads its state
+        // front to back. Every path keeps its own random sequence, so the order does not change
+        // the image.
+        size_t count = paths.size();
+        double lo[3], scale[3];
+        for(int axis = 0; axis < 3; axis++) {
+            const auto& ax = bounds.axis_interval(axis);
+            lo[axis] = ax.min;
+            scale[axis] = ax.size() > 0 ? 128 / ax.size() : 0;
+        }
+        batch.keys.resize(count);
+        for(size_t n = 0; n < count; n++) {
+            int k = paths[n];
+            const vec3& d = batch.direction[k];
+            uint32_t octant = (d.x() < 0 ? 4 : 0) | (d.y() < 0 ? 2 : 0) | (d.z() < 0 ? 1 : 0);
+            batch.keys[n] = uint64_t(octant << 21 | morton_code(lo, scale, batch.origin[k])) << 32 | uint32_t(k);
+        }
+
+        // 24 bit keys: three radix passes of 8 bits, the slot rides along in the low half
+        std::vector<uint64_t>& from = batch.keys;
+        std::vector<uint64_t>& to = batch.keys_scratch;
+        to.resize(count);
+        for(int shift = 32; shift < 56; shift += 8) {
+            size_t start[257] = {};
+            for(uint64_t key : from)
+                start[((key >> shift) & 255) + 1]++;
+            for(int b = 0; b < 256; b++)
+                start[b + 1] += start[b];
+            for(uint64_t key : from)
+                to[start[(key >> shift) & 255]++] = key;
+            std::swap(from, to);
+        }
+
+        // Sorted paths take the first slots, the others keep their order behind them
+        batch.target.assign(batch.count, -1);
+        for(size_t n = 0; n < count; n++)
+            batch.target[from[n] & 0xffffffff] = int(n);
+        int next = int(count);
+        for(int& t : batch.target)
+            if(t < 0)
+                t = next++;
+
+        // The other list of waiting paths follows its slots
+        std::vector<int>& others = &paths == &batch.active ? batch.shadowed : batch.active;
+        for(int& k : others)
+            k = batch.target[k];
+        batch.permute();
+        for(size_t n = 0; n < count; n++)
+            paths[n] = int(n);
+    }
+
+    static uint32_t morton_code(const double* lo, const double* scale, const point3& p) {
+        // 7 bits per axis, interleaved; points outside the bounds go to the border cells
+        uint32_t code = 0;
+        for(int axis = 0; axis < 3; axis++) {
+            double cell = (p[axis] - lo[axis]) * scale[axis];
+            uint32_t c = cell > 0 ? uint32_t(std::min(cell, 127.0)) : 0;
+            // Bit b to bit 3*b
+            c = (c | c << 8) & 0x0000f00f;
+            c = (c | c << 4) & 0x000c30c3;
+            c = (c | c << 2) & 0x00249249;
+            code |= c << (2 - axis);
+        }
+        return code;
+    }
+
+    void drawPixels(const hittable& world, const hittable& lights, double* array, int curr = 1, int threads = 1) {
+        auto begin = std::chrono::steady_clock::now();
+        auto rays = rays_traced();
+        auto nodes = bvh_nodes_visited();
+        auto allocs = heap_allocations();
+        for(int j = curr; j < image_height; j+= threads) {
+            for(int i = 0; i < image_width; i++)
+                render_pixel(world, lights, array, i, j);
+            std::lock_guard<std::mutex> lock(counterLock);
+            std::clog << "\rScanlines remaining: " << --counter << '\n' << std::flush;
+        }
+        std::chrono::duration<double> busy = std::chrono::steady_clock::now() - begin;
+        stats[curr].busy = busy.count();
+        stats[curr].rays = rays_traced() - rays;
+        stats[curr].nodes = bvh_nodes_visited() - nodes;
+        stats[curr].allocs = heap_allocations() - allocs;
+
+        if(threads != 1) {
             std::lock_guard<std::mutex> lock(finishLock);
             std::clog << "Thread " << curr << " finished\n" << std::flush;
-            return;
-        } else {
-            for(int j = curr; j < image_height; j+= 1) {
-                for(int i = 0; i < image_width; i++) {
-                    color pixel_color(0,0,0);
-                    for(int s_j = 0; s_j < sqrt_spp; s_j++) {
-                        for(int s_i = 0; s_i < sqrt_spp; s_i++) {
-                            ray r = get_ray(i, j, s_i, s_j);
-                            pixel_color += ray_color(r, max_depth, world, lights);
-                        }
+        }
+    }
+
+    void build_tiles() {
+        // Row-major tiles, none of them done yet
+        tiles.clear();
+        for(int y0 = 0; y0 < image_height; y0 += tile_size)
+            for(int x0 = 0; x0 < image_width; x0 += tile_size)
+                tiles.push_back({x0, y0, std::min(x0 + tile_size, image_width), std::min(y0 + tile_size, image_height)});
+        tile_done = std::vector<std::atomic<bool>>(tiles.size());
+        stop_tiles = false;
+    }
+
+    void queue_tiles(int threads) {
+        // The tiles not done yet, handed out to the workers in contiguous runs so each
+        // worker starts on a compact block of the image
+        pending.clear();
+        for(int i = 0; i < int(tiles.size()); i++)
+            if(!tile_done[i].load(std::memory_order_relaxed))
+                pending.push_back(i);
+
+        // Streaming needs the tiles finished roughly in image order, so all workers share one queue
+        int count = int(pending.size());
+        int runs = streaming ? 1 : threads;
+        queues = std::vector<tile_queue>(runs);
+        for(int i = 0; i < runs; i++) {
+            queues[i].next = int((long long)count * i / runs);
+            queues[i].end  = int((long long)count * (i+1) / runs);
+        }
+        counter = count;
+    }
+
+    bool next_tile(int curr, int& index, bool& stolen) {
+        // Own queue first, then steal from the other workers in round-robin order
+        if(stop_tiles.load(std::memory_order_relaxed))
+            return false;
+        int threads = int(queues.size());
+        for(int k = 0; k < threads; k++) {
+            auto& q = queues[(curr + k) % threads];
+            if(q.next.load(std::memory_order_relaxed) >= q.end)
+                continue;
+            int position = q.next.fetch_add(1, std::memory_order_relaxed);
+            if(position < q.end) {
+                index = pending[position];
+                stolen = (k != 0);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void drawTiles(const hittable& world, const hittable& lights, double* array, int curr) {
+        auto& st = stats[curr];
+        int index;
+        bool stolen;
+
+        // Packets need the shared pinhole origin of the primary rays, and a fixed sample count
+        bool packets = packet_size > 0 && defocus_angle <= 0 && max_depth > 0 && !adaptive;
+        bool wavefronts = use_wavefront();
+        wavefront_batch batch;
+
+        while(next_tile(curr, index, stolen)) {
+            auto begin = std::chrono::steady_clock::now();
+            auto rays = rays_traced();
+            auto nodes = bvh_nodes_visited();
+            auto allocs = heap_allocations();
+            const tile& tl = tiles[index];
+
+            // Streaming renders into the buffer of the tile's band, which starts at row0
+            int band = tl.y0 / tile_size;
+            int row0 = streaming ? band * tile_size : 0;
+            double* target = streaming ? acquire_band(band) : array;
+
+            if(wavefronts) {
+                render_wavefront(world, lights, tl, target, row0, batch);
+            } else if(packets) {
+                color block[ray_packet::max_size];
+                for(int y0 = tl.y0; y0 < tl.y1; y0 += packet_size) {
+                    for(int x0 = tl.x0; x0 < tl.x1; x0 += packet_size) {
+                        int x1 = std::min(x0 + packet_size, tl.x1);
+                        int y1 = std::min(y0 + packet_size, tl.y1);
+                        sample_packet(world, lights, x0, y0, x1, y1, block);
+                        for(int j = y0; j < y1; j++)
+                            for(int i = x0; i < x1; i++)
+                                set_pixel(target, i, j - row0, block[(j - y0)*(x1 - x0) + (i - x0)]);
                     }
-                    write_color(&array[image_width*j*3 + i*3], pixel_samples_scale * pixel_color);
                 }
-                std::clog << "\rScanlines remaining: " << --counter << '\n' << std::flush;
+            } else {
+                for(int j = tl.y0; j < tl.y1; j++)
+                    for(int i = tl.x0; i < tl.x1; i++)
+                        render_pixel(world, lights, target, i, j, row0);
+            }
+            if(streaming)
+                finish_band_tile(band);
+            tile_done[index].store(true, std::memory_order_release);
+            std::chrono::duration<double> busy = std::chrono::steady_clock::now() - begin;
+
+            st.busy += busy.count();
+            st.tiles++;
+            st.stolen += stolen;
+            st.rays += rays_traced() - rays;
+            st.nodes += bvh_nodes_visited() - nodes;
+            st.allocs += heap_allocations() - allocs;
+
+            std::lock_guard<std::mutex> lock(counterLock);
+            std::clog << "\rTiles remaining: " << --counter << '\n' << std::flush;
+        }
+
+        if(stats.size() > 1) {
+            std::lock_guard<std::mutex> lock(finishLock);
+            std::clog << "Thread " << curr << " finished\n" << std::flush;
+        }
+    }
+
+    void begin_stream(int threads) {
+        int rows_of_tiles = (image_height + tile_size - 1) / tile_size;
+        int tiles_per_row = (image_width + tile_size - 1) / tile_size;
+        bands.assign(rows_of_tiles, band_buffer());
+        for(auto& band : bands)
+            band.tiles_left = tiles_per_row;
+        band_limit = max_bands_in_flight > 0 ? max_bands_in_flight : 2 * threads;
+        bands_written = bands_alive = bands_peak = 0;
+        stream = make_shared<image_stream>(make_image_writer(format, output), "../Rendered_Images/"+output, image_width, image_height);
+    }
+
+    double* acquire_band(int band) {
+        // Blocks while the band is band_limit or more ahead of the next band to be written.
+        // Tiles are handed out in order, so the band being waited for is always in progress.
+        std::unique_lock<std::mutex> lock(streamLock);
+        band_written.wait(lock, [&] {return band < bands_written + band_limit;});
+        auto& b = bands[band];
+        if(b.pixels.empty()) {
+            int rows = std::min(tile_size, image_height - band * tile_size);
+            b.pixels.resize(size_t(rows) * image_width * 3);
+            bands_peak = std::max(bands_peak, ++bands_alive);
+        }
+        return b.pixels.data();
+    }
+
+    void finish_band_tile(int band) {
+        {
+            std::lock_guard<std::mutex> lock(streamLock);
+            bands[band].tiles_left--;
+        }
+        // One thread at a time writes, holding writerLock instead of streamLock, so workers that
+        // finish tiles or wait in acquire_band() are not held up by the disk. If another thread is
+        // writing, it takes over this band: it looks for ready bands again after letting go.
+        while(true) {
+            {
+                std::unique_lock<std::mutex> writer(writerLock, std::try_to_lock);
+                if(!writer.owns_lock())
+                    return;
+                write_ready_bands();
+            }
+            std::lock_guard<std::mutex> lock(streamLock);
+            if(!band_ready(bands_written))
+                return;
+        }
+    }
+
+    bool band_ready(int band) const {
+        return band < int(bands.size()) && bands[band].tiles_left == 0;
+    }
+
+    void write_ready_bands() {
+        // Writes every finished band at the front of the image, in order, and frees its buffer.
+        // Only called under writerLock; the buffers of finished bands are not touched by workers.
+        while(true) {
+            int first, last;
+            {
+                std::lock_guard<std::mutex> lock(streamLock);
+                first = last = bands_written;
+                while(band_ready(last))
+                    last++;
+            }
+            if(first == last)
+                return;
+
+            for(int band = first; band < last; band++) {
+                int y0 = band * tile_size;
+                stream->write_rows(bands[band].pixels.data(), y0, std::min(y0 + tile_size, image_height));
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(streamLock);
+                for(int band = first; band < last; band++)
+                    std::vector<double>().swap(bands[band].pixels);
+                bands_alive -= last - first;
+                bands_written = last;
             }
+            band_written.notify_all();
+        }
+    }
+
+    checkpoint_settings checkpoint_config() const {
+        checkpoint_settings s;
+        s.width = image_width;
+        s.height = image_height;
+        s.tile_size = tile_size;
+        s.sqrt_spp = sqrt_spp;
+        s.max_depth = max_depth;
+        s.integrator = integrator;
+        s.rr_min_depth = rr_min_depth;
+        s.mode = mode;
+        s.ao_distance = mode == ambientOcclusion ? ao_distance : 0;
+        s.adaptive = adaptive;
+        s.max_samples_per_pixel = adaptive ? max_samples_per_pixel : 0;
+        s.adaptive_tolerance = adaptive ? adaptive_tolerance : 0;
+        s.seed = seed;
+        return s;
+    }
+
+    template <typename F>
+    void for_tile_rows(int index, F&& row) const {
+        // row(y, first pixel, pixel count) for every row of the tile
+        const tile& tl = tiles[index];
+        for(int y = tl.y0; y < tl.y1; y++)
+            row(y, size_t(y) * image_width + tl.x0, size_t(tl.x1 - tl.x0));
+    }
+
+    bool save_checkpoint(const double* img) const {
+        // Snapshot of the finished tiles first, their pixels are no longer written to
+        std::vector<uint8_t> done(tiles.size());
+        for(size_t i = 0; i < done.size(); i++)
+            done[i] = tile_done[i].load(std::memory_order_acquire);
+
+        return write_checkpoint("../Rendered_Images/" + checkpoint, checkpoint_config(), done, [&](int index, std::ostream& file) {
+            for_tile_rows(index, [&](int, size_t first, size_t count) {
+                file.write(reinterpret_cast<const char*>(img + first * 3), std::streamsize(count * 3 * sizeof(double)));
+                if(adaptive)
+                    file.write(reinterpret_cast<const char*>(&samples_taken[first]), std::streamsize(count * sizeof(int)));
+            });
+        });
+    }
+
+    void load_checkpoint(double* img) {
+        // Finished tiles of an earlier run with the same settings, a missing or foreign file starts over
+        std::string path = "../Rendered_Images/" + checkpoint;
+        std::vector<uint8_t> done(tiles.size());
+        bool resumed = read_checkpoint(path, checkpoint_config(), done, [&](int index, std::istream& file) {
+            for_tile_rows(index, [&](int, size_t first, size_t count) {
+                file.read(reinterpret_cast<char*>(img + first * 3), std::streamsize(count * 3 * sizeof(double)));
+                if(adaptive)
+                    file.read(reinterpret_cast<char*>(&samples_taken[first]), std::streamsize(count * sizeof(int)));
+            });
+        });
+
+        if(!resumed) {
+            if(std::filesystem::exists(path))
+                std::clog << "Checkpoint " << path << " does not match this render, starting over\n";
             return;
         }
+        int count = 0;
+        for(size_t i = 0; i < done.size(); i++) {
+            tile_done[i].store(done[i] != 0, std::memory_order_relaxed);
+            count += done[i];
+        }
+        std::clog << "Resuming from " << path << ": " << count << " of " << tiles.size() << " tiles done\n";
     }
 
+    static void on_signal(int sig) {
+        signal_received = sig;
+    }
+
+    std::thread start_checkpoints(const double* img) {
+        signal_received = 0;
+        checkpoint_exit = false;
+        previous_sigint = std::signal(SIGINT, on_signal);
+        previous_sigterm = std::signal(SIGTERM, on_signal);
+        return std::thread(&camera::checkpoint_loop, this, img);
+    }
+
+    void checkpoint_loop(const double* img) {
+        // Saves on schedule beside the workers. A signal stops the workers from taking new tiles,
+        // the final checkpoint is written by stop_checkpoints() once their tiles are done.
+        auto last = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(checkpointLock);
+        while(!checkpoint_exit) {
+            checkpoint_wake.wait_for(lock, std::chrono::milliseconds(100));
+            if(signal_received) {
+                stop_tiles = true;
+                return;
+            }
+            std::chrono::duration<double> since = std::chrono::steady_clock::now() - last;
+            if(checkpoint_exit || since.count() < checkpoint_interval)
+                continue;
+
+            lock.unlock();
+            if(!save_checkpoint(img))
+                std::cerr << "Could not write checkpoint ../Rendered_Images/" << checkpoint << '\n';
+            last = std::chrono::steady_clock::now();
+            lock.lock();
+        }
+    }
+
+    bool stop_checkpoints(std::thread& saver, const double* img) {
+        // Returns whether the render was interrupted, which leaves the checkpoint to resume from.
+        // A complete render removes it.
+        {
+            std::lock_guard<std::mutex> lock(checkpointLock);
+            checkpoint_exit = true;
+        }
+        checkpoint_wake.notify_all();
+        saver.join();
+        std::signal(SIGINT, previous_sigint);
+        std::signal(SIGTERM, previous_sigterm);
+
+        std::string path = "../Rendered_Images/" + checkpoint;
+        bool complete = std::all_of(tile_done.begin(), tile_done.end(), [](const std::atomic<bool>& d) {return d.load();});
+        if(complete) {
+            std::error_code error;
+            std::filesystem::remove(path, error);
+            return false;
+        }
+        if(save_checkpoint(img))
+            std::clog << "Render interrupted, finished tiles saved to " << path << ", render again to resume\n";
+        else
+            std::cerr << "Render interrupted, could not write checkpoint " << path << '\n';
+        return true;
+    }
+
+    void print_thread_stats(double wall) const {
+        // Idle time is the part of the wall-clock render a worker spent waiting for the others
+        double idle_sum = 0;
+        uint64_t rays = 0;
+        uint64_t nodes = 0;
+        uint64_t allocs = 0;
+        std::clog << "Thread statistics (" << (tile_size > 0 ? "tiles" : "scanlines") << "):\n";
+        for(size_t i = 0; i < stats.size(); i++) {
+            double idle = wall - stats[i].busy;
+            idle_sum += idle;
+            rays += stats[i].rays;
+            nodes += stats[i].nodes;
+            allocs += stats[i].allocs;
+            std::clog << "  Thread " << i << ": busy " << stats[i].busy << "s, idle " << idle << "s";
+            if(tile_size > 0)
+                std::clog << ", " << stats[i].tiles << " tiles (" << stats[i].stolen << " stolen)";
+            std::clog << '\n';
+        }
+        std::clog << "  Wall " << wall << "s, mean idle " << idle_sum / stats.size() << "s ("
+                  << 100.0 * idle_sum / (wall * stats.size()) << "%)\n";
+        std::clog << "  Rays " << rays << ", " << rays / wall / 1e6 << " Mrays/s\n";
+        std::clog << "  BVH nodes " << nodes << ", " << nodes / wall / 1e6 << " Mnodes/s\n";
+#ifdef RT_COUNT_ALLOCATIONS
+        std::clog << "  Heap allocations while rendering " << allocs << '\n';
+#endif
+    }
 
 };
 
@@ -6,12 +6,16 @@
 #include "scenes.h"
 
 #include <chrono>
+#ifdef _WIN32
 #include <windows.h>
+#endif
 using namespace std::chrono;
 
 int main() {
+#ifdef _WIN32
     //Prevent Sleep
     SetThreadExecutionState(ES_CONTINUOUS | ES_SYSTEM_REQUIRED | ES_AWAYMODE_REQUIRED);
+#endif
 
     //World
     hittable_list world;
@@ -20,6 +24,11 @@ int main() {
     //Camera
     camera cam;
 
+    //BVH Build Strategy
+    bvh_node::default_options.split  = bvh_options::sah;
+    bvh_node::default_options.layout = bvh_options::wide4;
+    bvh_node::default_options.report = true;
+
     //Scene
     scene12(world, lights, cam, 1600, 200, 200);
 
@@ -31,8 +40,10 @@ int main() {
 
     std::clog << "Render Time: " << duration.count() << " seconds.\n";
 
+#ifdef _WIN32
     //Allow Sleep
     SetThreadExecutionState(ES_CONTINUOUS);
+#endif
 
     return 0;
 }
\ No newline at end of file
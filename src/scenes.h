@@ -4,10 +4,13 @@
 #include "Helper\rtweekend.h"
 
 #include "Bounding_Volume_Hierarchies/bvh.h"
+#include "Bounding_Volume_Hierarchies/make_bvh.h"
 #include "camera.h"
 #include "Materials/constant_medium.h"
 #include "Hittable/hittable.h"
 #include "Hittable/hittable_list.h"
+#include "Hittable/light_sampler.h"
+#include "Hittable/mesh.h"
 #include "Materials/material.h"
 #include "Hittable/sphere.h"
 #include "Hittable/surface.h"
@@ -131,7 +134,7 @@ void scene3(hittable_list& world, hittable_list& lights, camera& cam, int image_
     }
 
     //Add BVH
-    world = hittable_list(make_shared<bvh_node>(world));
+    world = hittable_list(make_bvh(world));
 
     // Camera Resolution
     cam.aspect_ratio        = 16.0 / 9.0;
@@ -199,7 +202,7 @@ void scene4(hittable_list& world, hittable_list& lights, camera& cam, int image_
     }
 
     //Add BVH
-    world = hittable_list(make_shared<bvh_node>(world));
+    world = hittable_list(make_bvh(world));
 
     // Camera Resolution
     cam.aspect_ratio        = 16.0 / 9.0;
@@ -403,7 +406,6 @@ void scene10(hittable_list& world, hittable_list& lights, camera& cam, int image
     auto white = make_shared<lambertian>(color(.73, .73, .73));
     auto green = make_shared<lambertian>(color(.12, .45, .15));
     auto light = make_shared<diffuse_light>(color(15, 15, 15));
-    auto m     = shared_ptr<material>(); //Placeholder for Light
     //shared_ptr<material> aluminium = make_shared<metal>(color(0.8, 0.85, 0.88), 0.0);
     auto glass = make_shared<dielectric>(1.5);
 
@@ -431,9 +433,11 @@ void scene10(hittable_list& world, hittable_list& lights, camera& cam, int image
     //Lights
     world.add(make_shared<quad>(point3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), light));
 
-    //lights.add(make_shared<sphere>(point3(190, 90, 190), 90, m));
-    lights.add(make_shared<quad>(point3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), m));
-    
+    //lights.add(make_shared<sphere>(point3(190, 90, 190), 90, light));
+    lights.add(make_shared<quad>(point3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), light));
+
+    //Add BVH
+    world = hittable_list(make_bvh(world));
 
     // Camera Resolution
     cam.aspect_ratio        = 1.0;
@@ -464,7 +468,6 @@ void scene11(hittable_list& world, hittable_list& lights, camera& cam, int image
     auto white = make_shared<lambertian>(color(.73, .73, .73));
     auto green = make_shared<lambertian>(color(.12, .45, .15));
     auto light = make_shared<diffuse_light>(color(7, 7, 7));
-    auto m     = shared_ptr<material>(); //Placeholder for Light
 
     //Objects
     world.add(make_shared<quad>(point3(555, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), green));
@@ -484,7 +487,7 @@ void scene11(hittable_list& world, hittable_list& lights, camera& cam, int image
     world.add(make_shared<constant_medium>(box2, 0.01, color(1, 1, 1)));
 
     world.add(make_shared<quad>(point3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), light));
-    lights.add(make_shared<quad>(point3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), m));
+    lights.add(make_shared<quad>(point3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), light));
 
     // Camera Resolution
     cam.aspect_ratio        = 1.0;
@@ -534,7 +537,7 @@ void scene12(hittable_list& world, hittable_list& lights, camera& cam, int image
             boxes1.add(box(point3(x0, y0, z0), point3(x1, y1, z1), ground));
         }
     }
-    world.add(make_shared<bvh_node>(boxes1));
+    world.add(make_bvh(boxes1));
 
     auto center1 = point3(400, 400, 200);
     auto center2 = center1 + vec3(30, 0, 0);
@@ -563,15 +566,15 @@ void scene12(hittable_list& world, hittable_list& lights, camera& cam, int image
 
     world.add(make_shared<translate>(
         make_shared<rotate_y>(
-            make_shared<bvh_node>(boxes2), 15),
+            make_bvh(boxes2), 15),
             vec3(-100, 270, 395)
         )
     );
     world.add(make_shared<quad>(point3(123, 554, 147), vec3(300, 0, 0), vec3(0, 0, 265), light));
-    lights.add(make_shared<quad>(point3(123, 554, 147), vec3(300, 0, 0), vec3(0, 0, 265), shared_ptr<material>()));
+    lights.add(make_shared<quad>(point3(123, 554, 147), vec3(300, 0, 0), vec3(0, 0, 265), light));
 
     //Add BVH
-    world = hittable_list(make_shared<bvh_node>(world));
+    world = hittable_list(make_bvh(world));
 
 
     // Camera Resolution
@@ -596,4 +599,179 @@ void scene12(hittable_list& world, hittable_list& lights, camera& cam, int image
     return;
 }
 
+void scene13(hittable_list& world, hittable_list& lights, camera& cam, int image_width = 600, int samples_per_pixel = 200, int max_depth = 50) {
+    // Cornell Box Scene of scene10, the glass sphere as a triangle mesh
+    // Materials
+    auto red   = make_shared<lambertian>(color(.65, .05, .05));
+    auto white = make_shared<lambertian>(color(.73, .73, .73));
+    auto green = make_shared<lambertian>(color(.12, .45, .15));
+    auto light = make_shared<diffuse_light>(color(15, 15, 15));
+    auto glass = make_shared<dielectric>(1.5);
+
+    //Objects
+    world.add(make_shared<quad>(point3(555, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), green));
+    world.add(make_shared<quad>(point3(0, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), red));
+    world.add(make_shared<quad>(point3(0, 0, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
+    world.add(make_shared<quad>(point3(555, 555, 555), vec3(-555, 0, 0), vec3(0, 0, -555), white));
+    world.add(make_shared<quad>(point3(0, 0, 555), vec3(555, 0, 0), vec3(0, 555, 0), white));
+
+    shared_ptr<hittable> box1 = box(point3(0,0,0), point3(165, 330, 165), white);
+    box1 = make_shared<rotate_y>(box1, 15);
+    box1 = make_shared<translate>(box1, vec3(265, 0, 295));
+    world.add(box1);
+
+    //Glass Sphere, 512 x 256 quads (~260k triangles)
+    world.add(sphere_mesh(point3(190, 90, 190), 90, 512, glass));
+
+    //Lights
+    world.add(make_shared<quad>(point3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), light));
+    lights.add(make_shared<quad>(point3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), light));
+
+    //Add BVH
+    world = hittable_list(make_bvh(world));
+
+    // Camera Resolution
+    cam.aspect_ratio        = 1.0;
+    cam.image_width         = image_width;
+    cam.samples_per_pixel   = samples_per_pixel;
+    cam.max_depth           = max_depth;
+    cam.backgroundTex       = make_shared<solid_color>(color(0.0, 0.0, 0.0));
+
+    // Camera Position
+    cam.vfov     = 40;
+    cam.lookfrom = point3(278, 278, -800);
+    cam.lookat   = point3(278, 278, 0);
+    cam.vup      = vec3(0, 1, 0);
+
+    // Depth of Field
+    cam.defocus_angle = 0.0;
+
+    // FileName
+    cam.output = "scene13.ppm";
+    
+    return;
+}
+
+void scene14(hittable_list& world, hittable_list& lights, camera& cam, int image_width = 600, int samples_per_pixel = 200, int max_depth = 50) {
+    // Cornell Box Scene with a field of instances of one sphere mesh
+    // Materials
+    auto red   = make_shared<lambertian>(color(.65, .05, .05));
+    auto white = make_shared<lambertian>(color(.73, .73, .73));
+    auto green = make_shared<lambertian>(color(.12, .45, .15));
+    auto light = make_shared<diffuse_light>(color(15, 15, 15));
+    auto clay  = make_shared<lambertian>(color(.80, .60, .35));
+
+    //Objects
+    world.add(make_shared<quad>(point3(555, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), green));
+    world.add(make_shared<quad>(point3(0, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), red));
+    world.add(make_shared<quad>(point3(0, 0, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
+    world.add(make_shared<quad>(point3(555, 555, 555), vec3(-555, 0, 0), vec3(0, 0, -555), white));
+    world.add(make_shared<quad>(point3(0, 0, 555), vec3(555, 0, 0), vec3(0, 555, 0), white));
+
+    //Unit sphere mesh (~4k triangles) shared by 32 x 32 instances, each with its own scale and spin
+    shared_ptr<hittable> ball = sphere_mesh(point3(0, 0, 0), 1, 64, clay);
+    hittable_list balls;
+    for(int i = 0; i < 32; i++) {
+        for(int j = 0; j < 32; j++) {
+            auto radius = random_double(5, 8);
+            auto place = transform::translation(vec3(12 + 16.9 * i, radius, 12 + 16.9 * j))
+                       * transform::rotation_y(random_double(0, 360))
+                       * transform::scaling(vec3(radius, radius * random_double(0.6, 1.2), radius));
+            balls.add(make_shared<instance>(ball, place));
+        }
+    }
+    world.add(make_bvh(balls));
+
+    //Lights
+    world.add(make_shared<quad>(point3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), light));
+    lights.add(make_shared<quad>(point3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), light));
+
+    //Add BVH
+    world = hittable_list(make_bvh(world));
+
+    // Camera Resolution
+    cam.aspect_ratio        = 1.0;
+    cam.image_width         = image_width;
+    cam.samples_per_pixel   = samples_per_pixel;
+    cam.max_depth           = max_depth;
+    cam.backgroundTex       = make_shared<solid_color>(color(0.0, 0.0, 0.0));
+
+    // Camera Position
+    cam.vfov     = 40;
+    cam.lookfrom = point3(278, 450, -700);
+    cam.lookat   = point3(278, 150, 278);
+    cam.vup      = vec3(0, 1, 0);
+
+    // Depth of Field
+    cam.defocus_angle = 0.0;
+
+    // FileName
+    cam.output = "scene14.ppm";
+    
+    return;
+}
+
+void scene15(hittable_list& world, hittable_list& lights, camera& cam, int image_width = 600, int samples_per_pixel = 200, int max_depth = 50) {
+    // Cornell Box Scene lit by a ceiling of 256 small coloured lights
+    // Materials
+    auto red   = make_shared<lambertian>(color(.65, .05, .05));
+    auto white = make_shared<lambertian>(color(.73, .73, .73));
+    auto green = make_shared<lambertian>(color(.12, .45, .15));
+
+    //Objects
+    world.add(make_shared<quad>(point3(555, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), green));
+    world.add(make_shared<quad>(point3(0, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), red));
+    world.add(make_shared<quad>(point3(0, 0, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
+    world.add(make_shared<quad>(point3(555, 555, 555), vec3(-555, 0, 0), vec3(0, 0, -555), white));
+    world.add(make_shared<quad>(point3(0, 0, 555), vec3(555, 0, 0), vec3(0, 555, 0), white));
+
+    shared_ptr<hittable> box1 = box(point3(0,0,0), point3(165, 330, 165), white);
+    box1 = make_shared<rotate_y>(box1, 15);
+    box1 = make_shared<translate>(box1, vec3(265, 0, 295));
+    world.add(box1);
+
+    shared_ptr<hittable> box2 = box(point3(0,0,0), point3(165, 165, 165), white);
+    box2 = make_shared<rotate_y>(box2, -18);
+    box2 = make_shared<translate>(box2, vec3(130, 0, 65));
+    world.add(box2);
+
+    //Lights: 16 x 16 ceiling tiles of different colour and brightness, weighted by their power
+    std::vector<double> powers;
+    for(int i = 0; i < 16; i++) {
+        for(int j = 0; j < 16; j++) {
+            auto emit = color::random(0.2, 1) * random_double(1, 12);
+            auto light = make_shared<diffuse_light>(emit);
+            point3 corner(40 + 30 * i, 554, 40 + 30 * j);
+            world.add(make_shared<quad>(corner + vec3(16, 0, 16), vec3(-16, 0, 0), vec3(0, 0, -16), light));
+            lights.add(make_shared<quad>(corner + vec3(16, 0, 16), vec3(-16, 0, 0), vec3(0, 0, -16), light));
+            powers.push_back(16 * 16 * (0.2126 * emit.x() + 0.7152 * emit.y() + 0.0722 * emit.z()));
+        }
+    }
+    lights = hittable_list(make_shared<light_sampler>(lights, powers));
+
+    //Add BVH
+    world = hittable_list(make_bvh(world));
+
+    // Camera Resolution
+    cam.aspect_ratio        = 1.0;
+    cam.image_width         = image_width;
+    cam.samples_per_pixel   = samples_per_pixel;
+    cam.max_depth           = max_depth;
+    cam.backgroundTex       = make_shared<solid_color>(color(0.0, 0.0, 0.0));
+
+    // Camera Position
+    cam.vfov     = 40;
+    cam.lookfrom = point3(278, 278, -800);
+    cam.lookat   = point3(278, 278, 0);
+    cam.vup      = vec3(0, 1, 0);
+
+    // Depth of Field
+    cam.defocus_angle = 0.0;
+
+    // FileName
+    cam.output = "scene15.ppm";
+    
+    return;
+}
+
 #endif
\ No newline at end of file